@@ -2,10 +2,26 @@
 #include "motorControl.h"
 #include "PC_DATA.h"
 
-#define DWIN_VP_UPDOWN 0x50
-#define DWIN_VP_PRESETS 0x71
-#define DWIN_VP_CALIBRATE 0x81
-#define DWIN_VP_THEME 0x85
+// Touch keys upload to these VPs, the key code is in the low byte
+#define DWIN_VP_UPDOWN 0x5000
+#define DWIN_VP_PRESETS 0x7100
+#define DWIN_VP_CALIBRATE 0x8100
+#define DWIN_VP_THEME 0x8500
+#define DWIN_VP_KEY_MASK 0xFF00
+
+static dwin_shadow_t shadow;           // latest value per VP, written by any task
+static SemaphoreHandle_t shadow_lock = NULL;
+static TaskHandle_t displayTaskHandle = NULL;
+static volatile uint32_t tx_bytes = 0; // everything written to the DWIN UART
+static dwin_link_stats_t link_stats;
+static dwin_parser_t rx_parser;        // owned by dwin_rx_task
+static volatile uint32_t rx_acks = 0;
+static dwin_tx_t tx;                    // write ACK window, under tx_lock
+static SemaphoreHandle_t tx_lock = NULL;
+static SemaphoreHandle_t tx_room = NULL; // given when the window may have a free slot
+static volatile bool tx_tracking = false; // dwin_rx_task is reading the ACKs
+static volatile bool shadow_lost = false; // writes lost for good, display_task resends the fields
+static volatile int16_t shown_page = -1;  // last page set, resent with the fields
 
 static int64_t press_start_time = 0;
 int8_t selected_preset = 0;
@@ -14,16 +30,70 @@ static bool long_press_action_done = false;
 float target_position_mm = 0;
 float preset1_mm = 0, preset2_mm = 0, preset3_mm = 0;
 
+static void uart_send(const uint8_t *frame, size_t len, void *ctx)
+{
+    uart_write_bytes(DWIN_UART, (const char *)frame, len);
+    __atomic_fetch_add(&tx_bytes, len, __ATOMIC_RELAXED); // display_task and dwin_rx_task replays
+}
+
+// Once dwin_rx_task reads the ACKs every write takes a slot in the window
+// and waits while DWIN_TX_WINDOW are outstanding. replay marks writes that
+// may be sent twice after a timeout. Never called from dwin_rx_task, it
+// frees the slots.
+static void dwin_write(const void *data, size_t len, bool replay)
+{
+    if (!tx_tracking)
+    {
+        uart_send(data, len, NULL);
+        return;
+    }
+
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    while (!dwin_tx_room(&tx))
+    {
+        xSemaphoreGive(tx_lock);
+        xSemaphoreTake(tx_room, pdMS_TO_TICKS(DWIN_TX_WAIT_MS));
+        xSemaphoreTake(tx_lock, portMAX_DELAY);
+    }
+    dwin_tx_sent(&tx, data, len, replay, esp_timer_get_time());
+    uart_send(data, len, NULL);
+    xSemaphoreGive(tx_lock);
+}
+
+// One flush worth of frames, built under shadow_lock and sent after it is
+// released so a full ACK window never holds up the field writers. A flush
+// stays within the budget except for its first frame, which always goes.
+typedef struct {
+    uint8_t data[DISPLAY_BUDGET_BYTES + DWIN_FRAME_HEADER + DWIN_FRAME_DATA_MAX];
+    size_t len;
+} shadow_batch_t;
+
+static void shadow_collect(const uint8_t *frame, size_t len, void *ctx)
+{
+    shadow_batch_t *b = ctx;
+
+    memcpy(&b->data[b->len], frame, len);
+    b->len += len;
+}
+
+// Each frame carries its length after the 5A A5 header
+static void shadow_send(const shadow_batch_t *b)
+{
+    for (size_t at = 0; at < b->len; at += b->data[at + 2] + 3)
+        dwin_write(&b->data[at], b->data[at + 2] + 3, true);
+}
+
 void setPage(uint8_t page)
 {
     uint8_t cmd[] = {CMD_HEAD1, CMD_HEAD2, 0x07, CMD_WRITE, 0x00, 0x84, 0x5A, 0x01, 0x00, page};
-    uart_write_bytes(DWIN_UART, (const char *)cmd, sizeof(cmd));
+    shown_page = page;
+    dwin_write(cmd, sizeof(cmd), true);
 }
 
 void setBrightness(int8_t brightness)
 {
     int8_t cmd[] = {CMD_HEAD1, CMD_HEAD2, 0x04, CMD_WRITE, 0x00, 0x82, brightness};
-    uart_write_bytes(DWIN_UART, (const char *)cmd, sizeof(cmd));
+    dwin_write(cmd, sizeof(cmd), true);
 }
 
 void setText(long address, const char *text)
@@ -37,26 +107,26 @@ void setText(long address, const char *text)
     int8_t sendBuffer[6 + dataLen];
     memcpy(sendBuffer, startCmd, sizeof(startCmd));
     memcpy(sendBuffer + 6, text, dataLen);
-    uart_write_bytes(DWIN_UART, (const char *)sendBuffer, sizeof(sendBuffer));
+    dwin_write(sendBuffer, sizeof(sendBuffer), true);
 }
 
 void setVP(long address, int8_t data)
 {
     int8_t cmd[] = {CMD_HEAD1, CMD_HEAD2, 0x05, CMD_WRITE, (int8_t)((address >> 8) & 0xFF), (int8_t)(address & 0xFF), 0x00, data};
-    uart_write_bytes(DWIN_UART, (const char *)cmd, sizeof(cmd));
+    dwin_write(cmd, sizeof(cmd), true);
 }
 
 void restartHMI(void)
 {
     uint8_t cmd[] = {CMD_HEAD1, CMD_HEAD2, 0x07, CMD_WRITE, 0x00, 0x04, 0x55, 0xAA, CMD_HEAD1, CMD_HEAD2};
-    uart_write_bytes(DWIN_UART, (const char *)cmd, sizeof(cmd));
+    dwin_write(cmd, sizeof(cmd), false);
     vTaskDelay(pdMS_TO_TICKS(10));
 }
 
 void beepHMI()
 {
     int8_t cmd[] = {CMD_HEAD1, CMD_HEAD2, 0x05, CMD_WRITE, 0x00, 0xA0, 0x00, 0x7D};
-    uart_write_bytes(DWIN_UART, (const char *)cmd, sizeof(cmd));
+    dwin_write(cmd, sizeof(cmd), false);
 }
 
 static inline int constrainInt(int x, int a, int b)
@@ -69,30 +139,111 @@ static inline int constrainInt(int x, int a, int b)
         return x;
 }
 
-void display_set_page(uint16_t page)
+void display_init(void)
+{
+    dwin_shadow_init(&shadow);
+    shadow_lock = xSemaphoreCreateMutex();
+    dwin_tx_init(&tx);
+    tx_lock = xSemaphoreCreateMutex();
+    tx_room = xSemaphoreCreateBinary();
+}
+
+// Wake display_task, before it runs its first pass picks everything up
+static void display_wake(uint32_t events)
+{
+    if (displayTaskHandle)
+        xTaskNotify(displayTaskHandle, events, eSetBits);
+}
+
+static void display_queue(const display_msg_t *msg)
+{
+    if (xQueueSend(displayQueue, msg, 0))
+        display_wake(DISPLAY_EV_COMMAND);
+}
+
+static void display_command(display_cmd_t cmd, uint16_t value)
 {
     display_msg_t msg = {
-        .cmd = DISP_CMD_SET_PAGE,
-        .value = page};
-    xQueueSend(displayQueue, &msg, 0);
+        .cmd = cmd,
+        .value = value};
+    display_queue(&msg);
+}
+
+// Page, beep and brightness are commands: queued, and sent ahead of field
+// data the moment display_task sees them
+void display_set_page(uint16_t page)
+{
+    display_command(DISP_CMD_SET_PAGE, page);
+}
+
+// Before display_task runs (first-boot calibration) nothing drains the
+// queue, the beep goes out directly then
+void display_beep(void)
+{
+    if (displayTaskHandle == NULL)
+        beepHMI();
+    else
+        display_command(DISP_CMD_BEEP, 0);
+}
+
+void display_set_brightness(int8_t brightness)
+{
+    display_command(DISP_CMD_BRIGHTNESS, (uint8_t)brightness);
+}
+
+// Field data goes straight into the shadow, a newer value replaces one not
+// sent yet. Fields too long for the shadow take the command queue instead.
+static bool shadow_field(uint16_t addr, const void *data, size_t len)
+{
+    xSemaphoreTake(shadow_lock, portMAX_DELAY);
+    dwin_shadow_result_t r = dwin_shadow_write(&shadow, addr, data, len);
+    xSemaphoreGive(shadow_lock);
+
+    if (r == DWIN_SHADOW_CHANGED)
+        display_wake(DISPLAY_EV_FIELDS);
+    return r != DWIN_SHADOW_FULL;
 }
 
 void display_set_text(uint16_t addr, const char *txt)
 {
+    if (shadow_field(addr, txt, strlen(txt)))
+        return;
+
     display_msg_t msg = {
         .cmd = DISP_CMD_SET_TEXT,
         .addr = addr};
-    strncpy(msg.text, txt, sizeof(msg.text));
-    xQueueSend(displayQueue, &msg, 0);
+    strncpy(msg.text, txt, sizeof(msg.text) - 1);
+    display_queue(&msg);
 }
 
 void display_set_vp(uint16_t addr, uint16_t value)
 {
+    uint8_t data[2] = {value >> 8, value & 0xFF};
+
+    if (shadow_field(addr, data, sizeof(data)))
+        return;
+
     display_msg_t msg = {
         .cmd = DISP_CMD_SET_VP,
         .addr = addr,
         .value = value};
-    xQueueSend(displayQueue, &msg, 0);
+    display_queue(&msg);
+}
+
+void display_get_link_stats(dwin_link_stats_t *out)
+{
+    xSemaphoreTake(shadow_lock, portMAX_DELAY);
+    *out = link_stats;
+    xSemaphoreGive(shadow_lock);
+    out->rx_frames = rx_parser.frames;
+    out->rx_dropped = rx_parser.dropped;
+    out->acks = rx_acks;
+
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    out->ack_timeouts = tx.timeouts;
+    out->retransmits = tx.retransmits;
+    out->lost = tx.lost;
+    xSemaphoreGive(tx_lock);
 }
 
 void updatePackMeasurementsOnHMI(float voltage, float current, float soc)
@@ -116,7 +267,7 @@ void updatePackMeasurementsOnHMI(float voltage, float current, float soc)
     {                            // charging
         display_set_text(0x4000, buffer); // watts on charging display
         display_set_text(0x6000, "0           ");
-        display_set_text(0x3100, mappedValue + 5);
+        display_set_vp(0x3100, mappedValue + 5);
     }
     else
     {                            // discharging
@@ -167,6 +318,9 @@ int map_with_hysteresis(float height, int steps)
     else
         return 1;
 
+    float bottom_limit_mm, top_limit_mm;
+    dist_get_limits(&bottom_limit_mm, &top_limit_mm);
+
     float mapped = mapf(height, bottom_limit_mm, top_limit_mm, 0, steps - 1);
     int newVal = constrain((int)mapped + 1, 1, steps);
 
@@ -351,188 +505,272 @@ static void handle_preset_code(uint8_t code)
     }
 }
 
-static void dwin_rx_task(void *arg)
+static void on_updown(const dwin_frame_t *f)
 {
-    uint8_t data[64];
+    uint8_t code = f->vp & 0xFF;
+    motor_cmd_t cmd;
+
+    if (code == 0x01)
+        cmd = MOTOR_CMD_BACKWARD;
+    else if (code == 0x02)
+        cmd = MOTOR_CMD_FORWARD;
+    else if (code == 0x03 || code == 0x04)
+        cmd = MOTOR_CMD_STOP;
+    else
+        return;
 
-    while (1)
+    xQueueSend(motorQueue, &cmd, 0);
+}
+
+static void on_preset(const dwin_frame_t *f)
+{
+    handle_preset_code(f->vp & 0xFF);
+}
+
+static void on_calibrate(const dwin_frame_t *f)
+{
+    if ((f->vp & 0xFF) == 0x00)
     {
-        int len = uart_read_bytes(DWIN_UART, data, sizeof(data), pdMS_TO_TICKS(20));
+        motor_cmd_t cmd = MOTOR_CMD_CALIBRATE;
+        xQueueSend(motorQueue, &cmd, 0);
+    }
+}
+
+static void on_theme(const dwin_frame_t *f)
+{
+    if (f->len < 2)
+        return;
+
+    if (f->data[1] == 0x01)
+    {
+        saveTheme(2);
+        display_set_page(pcConnected ? 9 : 20);
+    }
+    else if (f->data[1] == 0x02)
+    {
+        saveTheme(1);
+        display_set_page(pcConnected ? 10 : 23);
+    }
+}
+
+typedef struct {
+    uint16_t vp;
+    uint16_t mask; // VP bits that must match
+    void (*handler)(const dwin_frame_t *f);
+} dwin_vp_handler_t;
+
+static const dwin_vp_handler_t vp_handlers[] = {
+    {DWIN_VP_UPDOWN, DWIN_VP_KEY_MASK, on_updown},
+    {DWIN_VP_PRESETS, DWIN_VP_KEY_MASK, on_preset},
+    {DWIN_VP_CALIBRATE, DWIN_VP_KEY_MASK, on_calibrate},
+    {DWIN_VP_THEME, DWIN_VP_KEY_MASK, on_theme},
+};
+
+// The panel lost writes a replay cannot bring back, or came back after
+// missing some: display_task sends every field and the page again
+static void display_resync(void)
+{
+    shadow_lost = true;
+    display_wake(DISPLAY_EV_FIELDS);
+}
+
+static void on_ack(const dwin_frame_t *f)
+{
+    if (f->len < 2 || f->data[0] != 0x4F || f->data[1] != 0x4B) // "OK"
+        return;
 
-        // if (len > 0)
-        // {
-        //     printf("RX (%d): ", len);
-        //     for (int i = 0; i < len; i++)
-        //         printf("%02X ", data[i]);
-        //     printf("\n");
-        // }
+    rx_acks++;
+    if (!tx_tracking)
+        return;
 
-        // -------------------------------------------------------
-        //  FIX: Process ALL packets inside the received buffer
-        // -------------------------------------------------------
-        int8_t index = 0;
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    bool back = dwin_tx_ack(&tx);
+    xSemaphoreGive(tx_lock);
+    xSemaphoreGive(tx_room);
+    if (back)
+        display_resync();
+}
 
-        while (index + 9 <= len) // at least 1 full packet available
+static void on_frame(const dwin_frame_t *f, void *ctx)
+{
+    if (f->cmd == DWIN_RX_WRITE)
+    {
+        on_ack(f);
+        return;
+    }
+    if (f->cmd != DWIN_RX_READ)
+        return;
+
+    for (size_t i = 0; i < sizeof(vp_handlers) / sizeof(vp_handlers[0]); i++)
+    {
+        if ((f->vp & vp_handlers[i].mask) == vp_handlers[i].vp)
         {
-            // Search for packet header
-            if (data[index] == 0x5A && data[index + 1] == 0xA5)
-            {
-                uint8_t *pkt = &data[index]; // pointer to this packet
-
-                uint8_t vp = pkt[4];
-                uint8_t code = pkt[5];
-
-                // ------------------ UP/DOWN Buttons -------------------
-                if (vp == DWIN_VP_UPDOWN)
-                {
-                    motor_cmd_t cmd;
-
-                    if (code == 0x01)
-                    {
-                        cmd = MOTOR_CMD_BACKWARD;
-                        // printf("Downward\r\n");
-                    }
-                    else if (code == 0x02)
-                    {
-                        cmd = MOTOR_CMD_FORWARD;
-                        // printf("Upward\r\n");
-                    }
-                    else if (code == 0x03 || code == 0x04)
-                    {
-                        cmd = MOTOR_CMD_STOP;
-                        // printf("STOP\r\n");
-                    }
-                    else
-                    {
-                        index += 1;
-                        continue;
-                    }
-
-                    xQueueSend(motorQueue, &cmd, 0);
-                }
-
-                // ------------------ PRESET BUTTONS --------------------
-                else if (vp == DWIN_VP_PRESETS)
-                {
-                    handle_preset_code(code);
-                }
-
-                // ------------------ CALIBRATE BUTTON ------------------
-                else if (vp == DWIN_VP_CALIBRATE)
-                {
-                    if (code == 0x00)
-                    {
-                        // printf("Calibrate\r\n");
-                        motor_cmd_t cmd = MOTOR_CMD_CALIBRATE;
-                        xQueueSend(motorQueue, &cmd, 0);
-                    }
-                }
-
-                // ------------------- DARK/LIGHT THEME ------------------
-                else if (vp == DWIN_VP_THEME)
-                {
-                    if (pkt[8] == 0x01)
-                    {
-                        saveTheme(2);
-                        if (pcConnected)
-                        {
-                            setPage(9);
-                        }
-                        else
-                        {
-                            setPage(20);
-                        }
-                    }
-                    else if (pkt[8] == 0x02)
-                    {
-                        saveTheme(1);
-                        if (pcConnected)
-                        {
-                            setPage(10);
-                        }
-                        else
-                        {
-                            setPage(23);
-                        }
-                    }
-                }
-
-                // move to next packet
-                index += 9;
-            }
-            else
-            {
-                index++; // try next byte
-            }
+            vp_handlers[i].handler(f);
+            return;
         }
-
-        vTaskDelay(pdMS_TO_TICKS(10));
     }
 }
 
-void display_task(void *arg)
+// Frames are put together across reads; a read that times out with no
+// data is an idle line and ends a frame left open. ACKs of the writes made
+// before this task ran are flushed unread, tracking starts after them.
+static void dwin_rx_task(void *arg)
 {
+    uint8_t data[64];
+
+    dwin_parser_init(&rx_parser);
+    uart_flush_input(DWIN_UART);
+    tx_tracking = true;
+
     while (1)
     {
-        if (current_height_mm > 0) // valid reading
-        {
-            // HYSTERESIS MAPPING
-            int mappedValue = map_with_hysteresis(current_height_mm, 10);        // step 1–10
-            int mappedNumValue = map_with_hysteresis(current_height_mm, 20) - 1; // step 0–19
+        int len = uart_read_bytes(DWIN_UART, data, sizeof(data), pdMS_TO_TICKS(20));
 
-            // Track old values and update display only on change
-            static int prevMappedValue = -1;
-            static int prevMappedNumValue = -1;
+        if (len > 0)
+            dwin_parser_feed(&rx_parser, data, len, on_frame, NULL);
+        else
+            dwin_parser_idle(&rx_parser);
+
+        xSemaphoreTake(tx_lock, portMAX_DELAY);
+        dwin_tx_result_t r = dwin_tx_poll(&tx, esp_timer_get_time(), uart_send, NULL);
+        xSemaphoreGive(tx_lock);
+        if (r != DWIN_TX_OK)
+            xSemaphoreGive(tx_room);
+        if (r == DWIN_TX_LOST)
+            display_resync();
+    }
+}
 
-            if (mappedValue != prevMappedValue)
-            {
-                char txt[8];
-                snprintf(txt, sizeof(txt), "%02d", mappedValue);
-                setText(0x1000, txt);
+static void run_command(const display_msg_t *msg)
+{
+    switch (msg->cmd)
+    {
+    case DISP_CMD_SET_PAGE:
+        setPage(msg->value);
+        break;
 
-                prevMappedValue = mappedValue;
+    case DISP_CMD_BEEP:
+        beepHMI();
+        break;
 
-                // printf("Height: %f\n", current_height_mm);
-                // printf("Mapped Value = %d\r\n", mappedValue);
-                // printf("bottom=%f  top=%f\n", bottom_limit_mm, top_limit_mm);
-            }
+    case DISP_CMD_BRIGHTNESS:
+        setBrightness((int8_t)msg->value);
+        break;
 
-            if (mappedNumValue != prevMappedNumValue)
-            {
-                setVP(0x8100, mappedNumValue);
-                prevMappedNumValue = mappedNumValue;
+    case DISP_CMD_SET_TEXT:
+        setText(msg->addr, msg->text);
+        break;
 
-                // printf("Mapped Num Value = %d\r\n", mappedNumValue);
-            }
+    case DISP_CMD_SET_VP:
+        setVP(msg->addr, msg->value);
+        break;
+    }
+}
+
+// Height bar and step text from the latest height
+static void show_height(void)
+{
+    height_state_t s;
+    dist_get_state(&s);
+
+    // The shadow drops the writes that change nothing
+    if (s.valid && s.height_mm > 0) // valid reading
+    {
+        // HYSTERESIS MAPPING
+        int mappedValue = map_with_hysteresis(s.height_mm, 10);        // step 1–10
+        int mappedNumValue = map_with_hysteresis(s.height_mm, 20) - 1; // step 0–19
+        char txt[8];
+
+        snprintf(txt, sizeof(txt), "%02d", mappedValue);
+        display_set_text(0x1000, txt);
+        display_set_vp(0x8100, mappedNumValue);
+    }
+}
+
+// Sleeps until something changes: a queued command, a field write, or the
+// height moving by DISPLAY_HEIGHT_STEP. Commands are sent at once. Changed
+// fields go out at most every DISPLAY_FLUSH_MS, within what the link
+// carries in that time less the bytes the commands took; the rest waits
+// for the next flush.
+void display_task(void *arg)
+{
+    const TickType_t interval = pdMS_TO_TICKS(DISPLAY_FLUSH_MS);
+    TickType_t last_flush = xTaskGetTickCount() - interval;
+    uint32_t cycle_start = tx_bytes;
+    uint32_t events = DISPLAY_EV_COMMAND | DISPLAY_EV_HEIGHT | DISPLAY_EV_FIELDS; // catch up on boot
+    bool pending = false;
+
+    dist_notify_on_change(xTaskGetCurrentTaskHandle(), DISPLAY_EV_HEIGHT, DISPLAY_HEIGHT_STEP);
+
+    while (1)
+    {
+        if (events & DISPLAY_EV_COMMAND)
+        {
+            display_msg_t msg;
+            while (xQueueReceive(displayQueue, &msg, 0))
+                run_command(&msg);
         }
+        if (shadow_lost)
+        {
+            shadow_lost = false;
+            if (shown_page >= 0)
+                setPage(shown_page);
+            xSemaphoreTake(shadow_lock, portMAX_DELAY);
+            dwin_shadow_forget(&shadow);
+            xSemaphoreGive(shadow_lock);
+        }
+        if (events & DISPLAY_EV_HEIGHT)
+            show_height();
+        if (events & (DISPLAY_EV_FIELDS | DISPLAY_EV_HEIGHT))
+            pending = true;
 
-        display_msg_t msg;
-        while (xQueueReceive(displayQueue, &msg, 0)) 
+        TickType_t since = xTaskGetTickCount() - last_flush;
+        if (pending && since >= interval)
         {
-            switch (msg.cmd)
-            {
-            case DISP_CMD_SET_PAGE:
-                setPage(msg.value);
-                break;
-
-            case DISP_CMD_SET_TEXT:
-                setText(msg.addr, msg.text);
-                break;
-
-            case DISP_CMD_SET_VP:
-                setVP(msg.addr, msg.value);
-                break;
-                
-            }
+            uint32_t used = tx_bytes - cycle_start;
+            shadow_batch_t batch = {.len = 0};
+
+            xSemaphoreTake(shadow_lock, portMAX_DELAY);
+            if (used < DISPLAY_BUDGET_BYTES)
+                dwin_shadow_flush(&shadow, DISPLAY_BUDGET_BYTES - used, shadow_collect, &batch);
+            pending = dwin_shadow_dirty(&shadow);
+            link_stats.frames = shadow.frames;
+            link_stats.writes = shadow.writes;
+            link_stats.suppressed = shadow.suppressed;
+            xSemaphoreGive(shadow_lock);
+
+            shadow_send(&batch);
+
+            uint32_t bytes = tx_bytes - cycle_start;
+            cycle_start = tx_bytes;
+            last_flush = xTaskGetTickCount();
+            since = 0;
+
+            // Counted once the frames are out, under the lock the getter reads with
+            xSemaphoreTake(shadow_lock, portMAX_DELAY);
+            link_stats.cycles++;
+            link_stats.last_bytes = bytes;
+            if (bytes > link_stats.max_bytes)
+                link_stats.max_bytes = bytes;
+            link_stats.total_bytes += bytes;
+            if (pending)
+                link_stats.deferred++;
+            xSemaphoreGive(shadow_lock);
         }
 
-        vTaskDelay(pdMS_TO_TICKS(200)); // update every 200ms
+        // Only a flush held back by the rate limit needs a timeout
+        TickType_t wait = pending ? interval - since : portMAX_DELAY;
+        events = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &events, wait);
+        xSemaphoreTake(shadow_lock, portMAX_DELAY);
+        link_stats.wakeups++;
+        xSemaphoreGive(shadow_lock);
     }
 }
 
 void start_animDisp_task()
 {
-    xTaskCreate(display_task, "display_task", 2048, NULL, 4, NULL);
+    xTaskCreate(display_task, "display_task", 2048, NULL, 4, &displayTaskHandle);
 }
 
 void start_dwin_task()
@@ -7,6 +7,11 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "dwinShadow.h"
+#include "dwinParser.h"
+#include "dwinTx.h"
+#include "esp_timer.h"
 
 #define DWIN_UART  UART_NUM_1
 
@@ -18,28 +23,72 @@
 #define MIN_ASCII 32
 #define MAX_ASCII 255
 
+#define DWIN_VP_ETA 0x1900 // goto countdown in seconds, please-wait pages 16/17
+
+// Changed fields leave at most once per DISPLAY_FLUSH_MS, within what the
+// 9600 baud link (960 bytes/s) carries in that time, less a quarter kept
+// for commands
+#define DWIN_BAUD 9600
+#define DISPLAY_FLUSH_MS 100
+#define DISPLAY_BUDGET_BYTES (DWIN_BAUD / 10 * DISPLAY_FLUSH_MS / 1000 * 3 / 4)
+#define DISPLAY_HEIGHT_STEP 0.05f // height change that wakes display_task, well inside a bar step
+#define DWIN_TX_WAIT_MS 10        // writer re-checks the ACK window at least this often
+
+// display_task notification bits
+#define DISPLAY_EV_COMMAND 0x01 // displayQueue has a command
+#define DISPLAY_EV_FIELDS 0x02  // a shadow field changed
+#define DISPLAY_EV_HEIGHT 0x04  // the height moved by DISPLAY_HEIGHT_STEP
+
 extern QueueHandle_t motorQueue;
 extern QueueHandle_t displayQueue;
 
+// displayQueue carries commands; field data goes to the shadow and only
+// takes the queue when it does not fit there
 typedef enum {
     DISP_CMD_SET_PAGE,
     DISP_CMD_SET_TEXT,
-    DISP_CMD_SET_VP
+    DISP_CMD_SET_VP,
+    DISP_CMD_BEEP,
+    DISP_CMD_BRIGHTNESS
 } display_cmd_t;
 
 
 typedef struct {
     display_cmd_t cmd;
     uint16_t addr;      // For text or VP
-    char text[16];
+    char text[DWIN_SHADOW_FIELD_MAX + 1];
     uint16_t value;
 } display_msg_t;
 
+// DWIN link load, one cycle is one flush of the field shadow
+typedef struct {
+    uint32_t cycles;
+    uint32_t last_bytes;   // written in the last cycle
+    uint32_t max_bytes;
+    uint32_t total_bytes;
+    uint32_t frames;       // VP write frames after coalescing
+    uint32_t writes;       // VP field writes requested
+    uint32_t suppressed;   // writes dropped, the display already showed them
+    uint32_t deferred;     // cycles that left fields for the next one, over the byte budget
+    uint32_t wakeups;      // display_task wake-ups, events and rate-limit timeouts
+    uint32_t rx_frames;    // frames from the display
+    uint32_t rx_dropped;   // partial or malformed frames
+    uint32_t acks;         // write ACKs
+    uint32_t ack_timeouts; // writes whose ACK never came
+    uint32_t retransmits;  // write frames sent again after a timeout
+    uint32_t lost;         // timeouts a resend could not cover, all fields resent
+} dwin_link_stats_t;
+
 void setPage(uint8_t page);
 void start_dwin_task();
 void start_animDisp_task();
 
+void display_init(void);
 void display_set_page(uint16_t page);
+void display_beep(void);
+void display_set_brightness(int8_t brightness);
 void display_set_text(uint16_t addr, const char *txt);
+void display_set_vp(uint16_t addr, uint16_t value);
+void display_get_link_stats(dwin_link_stats_t *out);
 void updatePackMeasurementsOnHMI(float voltage, float current, float soc);
 void updatePackTempOnHMI(int tempMin, int tempMax, float tempAverage);
\ No newline at end of file
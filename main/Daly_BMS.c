@@ -4,6 +4,9 @@
 #include "motorControl.h"
 
 bool motorLockedLowSOC = false;
+power_envelope_t powerEnvelope;
+static const power_cfg_t power_cfg = POWER_CFG_DEFAULT;
+static bool lockShown = false; // lock page up, alerts re-sync when it lifts
 static int lastAlertSOC = 100; // start high
 static int prevSOC = -1;
 
@@ -79,27 +82,48 @@ bool getPackTemp(void)
     return true;
 }
 
+// Derating and lockout from the latest readings. A failed read keeps the
+// previous values; until the first temperature read the pack counts as mild.
+static void updatePowerEnvelope(bool pack_ok, bool temp_ok)
+{
+    static bool havePack = false, haveTemp = false;
+
+    havePack |= pack_ok;
+    haveTemp |= temp_ok;
+    if (!havePack)
+        return;
+
+    float tmin = haveTemp ? g_temp.min_temp : 25.0f;
+    float tmax = haveTemp ? g_temp.max_temp : 25.0f;
+
+    // The PC reads the envelope with TRACE_OP_POWER
+    power_envelope_update(&powerEnvelope, &power_cfg, g_pack.pack_soc, tmin, tmax);
+    motorLockedLowSOC = powerEnvelope.locked;
+}
+
 void handleSOCLogic(int soc)
 {
     if (soc < 0)
         return;
 
-    /* ---------- HARD LOCK BELOW 3% ---------- */
-    if (soc < 3)
+    /* ---------- HARD LOCK: PACK EMPTY OR TOO HOT ---------- */
+    // Above the lock the power envelope only derates, slow lifts still work
+    if (motorLockedLowSOC)
     {
-        motorLockedLowSOC = true;
+        lockShown = true;
         motor_stop();
-        display_set_page(12); // critical SOC alert change page with connect charger also add beep
-        beepHMI();
+        // The HMI has one lock page for both causes, empty or too hot
+        display_set_page(12);
+        display_beep();
         vTaskDelay(pdMS_TO_TICKS(1000));
         prevSOC = soc;
         return;
     }
 
-    /* ---------- UNLOCK WHEN SOC RECOVERS ---------- */
-    if (motorLockedLowSOC && soc >= 3)
+    /* ---------- UNLOCK WHEN THE PACK RECOVERS ---------- */
+    if (lockShown)
     {
-        motorLockedLowSOC = false;
+        lockShown = false;
 
         // Re-sync alert level but DO NOT trigger alert
         lastAlertSOC = soc - (soc % 5);
@@ -159,7 +183,6 @@ static void bmsTask(void *arg)
         if (pack_ok)
         {
             updatePackMeasurementsOnHMI(g_pack.pack_voltage, g_pack.pack_current, g_pack.pack_soc);
-            handleSOCLogic((int)g_pack.pack_soc);
             if (pcConnected)
             {
                 pc_send_pack_data(g_pack.pack_voltage,
@@ -213,9 +236,14 @@ static void bmsTask(void *arg)
             // printf("[TEMP] read failed\n");
         }
 
+        // Alerts and the lock once both readings are in
+        updatePowerEnvelope(pack_ok, temp_ok);
+        if (pack_ok)
+            handleSOCLogic((int)g_pack.pack_soc);
+
         if (motorLockedLowSOC)
         {
-            vTaskDelay(pdMS_TO_TICKS(1000)); // 1 sec when SOC < 3%
+            vTaskDelay(pdMS_TO_TICKS(1000)); // 1 sec while locked
         }
         else
         {
@@ -2,10 +2,12 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "driver/uart.h"
+#include "powerEnvelope.h"
 
 #define BMS_UART UART_NUM_2
 
-extern bool motorLockedLowSOC;
+extern bool motorLockedLowSOC;        // power envelope lock: pack empty or too hot
+extern power_envelope_t powerEnvelope; // derating the motor follows
 typedef enum {
     VOUT_IOUT_SOC = 0x90,
     MIN_MAX_TEMPERATURE = 0x92,
@@ -1,17 +1,163 @@
 
 #include "dist.h"
 #include "motorControl.h"
+#include "heightFilter.h"
+#include "nvsManager.h"
+#include "seqlock.h"
+#include "adcTrace.h"
+#include "freertos/semphr.h"
 
-float current_height_mm = 0; // live height from sensor
+// Latest height, written by the sampler only, read lock-free by everyone else
+static seqlock_t height_lock;
+static height_state_t height_state;
 
-float top_limit_mm = 0;
-float bottom_limit_mm = 0;
-float center_mm = 0;
+// Soft limits found by calibration
+static seqlock_t limits_lock;
+static float bottom_limit_mm = 0;
+static float top_limit_mm = 0;
+
+// Sampling profiles, see dist.h
+typedef struct {
+    uint32_t rate_hz;
+    uint16_t frame;  // conversions per DMA frame
+    uint8_t window;  // median window
+} dist_profile_cfg_t;
+
+static const dist_profile_cfg_t profiles[] = {
+    [DIST_PROFILE_IDLE] = {DIST_IDLE_RATE_HZ, DIST_IDLE_FRAME, DIST_IDLE_WINDOW},
+    [DIST_PROFILE_MOVING] = {DIST_MOVING_RATE_HZ, DIST_MOVING_FRAME, DIST_MOVING_WINDOW}};
+
+static const dist_profile_cfg_t *profile = &profiles[DIST_PROFILE_IDLE];
+static TaskHandle_t distTaskHandle = NULL;
+
+// Continuous (DMA) sampling state
+static QueueHandle_t heightMailbox = NULL; // latest filtered height, overwritten every frame
+static uint16_t raw_ring[DIST_RING_LEN];   // last raw ADC codes from the DMA stream
+static uint32_t raw_count = 0;             // total samples pushed into raw_ring
+static bool streaming = false;
+static height_filter_t filter;             // median + estimator + health monitor
+static int64_t last_publish_us = 0;
+static uint32_t poll_count = 0;            // samples taken by the polling path
+static ir_cal_t ir_cal;                    // calibration points, mirrored in NVS as "ir_cal"
+static SemaphoreHandle_t cal_lock = NULL;  // ir_cal changes: PC task and motor_task (calibration)
+
+// One task woken when the height moves, instead of polling it
+static TaskHandle_t watch_task = NULL;
+static uint32_t watch_bits;
+static float watch_step;
+static float watch_height = -1000.0f;      // height at the last wake-up
 
 void adc_init()
 {
     adc1_config_width(ADC_WIDTH_BIT_12);
     adc1_config_channel_atten(ADC1_CHANNEL_2, ADC_ATTEN_DB_11);
+    ir_curve_init();
+    cal_lock = xSemaphoreCreateMutex();
+
+    // Apply the stored calibration curve on top of the factory one
+    if (load_blob("ir_cal", &ir_cal, sizeof(ir_cal)) && ir_cal_valid(&ir_cal))
+        ir_curve_apply_cal(&ir_cal);
+    else
+        ir_cal_clear(&ir_cal);
+
+    height_filter_init(&filter, profile->window, profile->rate_hz);
+}
+
+static bool adc_stream_start(const dist_profile_cfg_t *cfg)
+{
+    adc_digi_init_config_t init_cfg = {
+        .max_store_buf_size = cfg->frame * DIST_RESULT_BYTES * 4,
+        .conv_num_each_intr = cfg->frame * DIST_RESULT_BYTES,
+        .adc1_chan_mask = BIT(IR_ADC_CHANNEL),
+        .adc2_chan_mask = 0};
+    if (adc_digi_initialize(&init_cfg) != ESP_OK)
+        return false;
+
+    adc_digi_pattern_config_t pattern = {
+        .atten = ADC_ATTEN_DB_11,
+        .channel = IR_ADC_CHANNEL,
+        .unit = 0, // ADC1
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH};
+
+    adc_digi_configuration_t dig_cfg = {
+        .conv_limit_en = 0,
+        .conv_limit_num = 250,
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = cfg->rate_hz,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2};
+    if (adc_digi_controller_configure(&dig_cfg) != ESP_OK)
+    {
+        adc_digi_deinitialize();
+        return false;
+    }
+
+    if (adc_digi_start() != ESP_OK)
+    {
+        adc_digi_deinitialize();
+        return false;
+    }
+    return true;
+}
+
+static void adc_stream_stop(void)
+{
+    adc_digi_stop();
+    adc_digi_deinitialize();
+}
+
+void dist_get_state(height_state_t *out)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = seqlock_read_begin(&height_lock);
+        *out = height_state;
+    } while (seqlock_read_retry(&height_lock, seq));
+}
+
+bool dist_state_fresh(const height_state_t *s, int64_t max_age_us)
+{
+    return s->valid && (esp_timer_get_time() - s->timestamp_us) <= max_age_us;
+}
+
+// Fresh, valid and confident enough to move the column on
+bool dist_sensor_trusted(void)
+{
+    height_state_t s;
+
+    dist_get_state(&s);
+    return dist_state_fresh(&s, DIST_STALE_US) && s.confidence >= DIST_MIN_CONFIDENCE;
+}
+
+float dist_height(void)
+{
+    height_state_t s;
+
+    dist_get_state(&s);
+    return s.height_mm;
+}
+
+void dist_set_limits(float bottom, float top)
+{
+    seqlock_write_begin(&limits_lock);
+    bottom_limit_mm = bottom;
+    top_limit_mm = top;
+    seqlock_write_end(&limits_lock);
+}
+
+void dist_get_limits(float *bottom, float *top)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = seqlock_read_begin(&limits_lock);
+        *bottom = bottom_limit_mm;
+        *top = top_limit_mm;
+    } while (seqlock_read_retry(&limits_lock, seq));
 }
 
 int8_t hit_bottom_limit()
@@ -19,10 +165,21 @@ int8_t hit_bottom_limit()
     if (gpio_get_level(PROXIMITY_BOTTOM))
         return 1;
 
-    if ((current_height_mm <= (bottom_limit_mm + 0.5f)) && !calibrating )   // 0.5mm tolerance
+    height_state_t s;
+    float bottom, top;
+
+    // Without a trustworthy height only the switch can be relied on
+    dist_get_state(&s);
+    if (!s.valid || s.confidence < DIST_MIN_CONFIDENCE)
+        return 0;
+
+    dist_get_limits(&bottom, &top);
+    float ahead = s.height_mm + s.velocity_mm_s * DIST_LIMIT_LOOKAHEAD_S;
+
+    if ((ahead <= (bottom + 0.5f)) && !calibrating )   // 0.5mm tolerance
         return 1;
 
-    if (current_height_mm <= 3.0f && !initial_calib)   // Hard-coded max height
+    if (s.height_mm <= 3.0f && !initial_calib)   // Hard-coded max height
         return 1;
     
     return 0;
@@ -34,95 +191,369 @@ int8_t hit_top_limit()
         return 1;
 
     
-    if ((current_height_mm >= (top_limit_mm - 0.1f)) && !calibrating)   // 0.1mm tolerance
+    height_state_t s;
+    float bottom, top;
+
+    dist_get_state(&s);
+    if (!s.valid || s.confidence < DIST_MIN_CONFIDENCE)
+        return 0;
+
+    dist_get_limits(&bottom, &top);
+    float ahead = s.height_mm + s.velocity_mm_s * DIST_LIMIT_LOOKAHEAD_S;
+
+    if ((ahead >= (top - 0.1f)) && !calibrating)   // 0.1mm tolerance
         return 1;
 
-    if (current_height_mm >= 20.0f)   // Hard-coded max height
+    if (s.height_mm >= 20.0f)   // Hard-coded max height
         return 1;
 
     return 0;
 }
 
-float median_filter(float *v, int n)
+// Motor state stamped on every traced sample
+static uint8_t trace_motor_state(void)
 {
-    // simple bubble sort
-    for (int i = 0; i < n - 1; i++)
-        for (int j = i + 1; j < n; j++)
-            if (v[j] < v[i]) {
-                float tmp = v[i];
-                v[i] = v[j];
-                v[j] = tmp;
-            }
+    uint8_t motor = current_dir & ADC_TRACE_DIR_MASK;
+
+    if (motorRunning)
+        motor |= ADC_TRACE_RUNNING;
+    if (profile == &profiles[DIST_PROFILE_MOVING])
+        motor |= ADC_TRACE_MOVING;
+    return motor;
+}
 
-    return v[n / 2];  // return median
+static void store_state(float height, float velocity, bool valid, uint32_t samples, int64_t now)
+{
+    seqlock_write_begin(&height_lock);
+    height_state.height_mm = height;
+    height_state.velocity_mm_s = velocity;
+    height_state.timestamp_us = now;
+    height_state.sample_count = samples;
+    height_state.valid = valid;
+    height_state.confidence = filter.health.confidence;
+    height_state.faults = filter.health.faults;
+    seqlock_write_end(&height_lock);
 }
 
-float smooth(float input)
+static void publish_frame(uint32_t samples)
 {
-    static float smooth_height = 0.0f;
-    static bool initialized = false;
+    int64_t now = esp_timer_get_time();
+    float dt = (now - last_publish_us) / 1000000.0f;
+    float height;
 
-    if (!initialized) {
-        smooth_height = input;   // start from real reading
-        initialized = true;
-    } else {
-        smooth_height = 0.7f * smooth_height + 0.3f * input;
+    last_publish_us = now;
+
+    // Window held no valid sample: keep the last height but flag it
+    if (!height_filter_frame(&filter, motor_commanded_velocity(), dt, &height))
+    {
+        store_state(height_state.height_mm, 0, false, samples, now);
+        return;
     }
 
-    return smooth_height;
+    store_state(height, filter.estimator.velocity, true, samples, now);
+
+    if (heightMailbox)
+        xQueueOverwrite(heightMailbox, &height);
+
+    if (watch_task && fabsf(height - watch_height) >= watch_step)
+    {
+        watch_height = height;
+        xTaskNotify(watch_task, watch_bits, eSetBits);
+    }
+}
+
+// `task` gets `bits` (eSetBits) whenever the height moved by `step` since
+// the last time it was woken
+void dist_notify_on_change(TaskHandle_t task, uint32_t bits, float step)
+{
+    watch_bits = bits;
+    watch_step = step;
+    watch_task = task;
+}
+
+bool dist_wait_height(float *height, TickType_t timeout)
+{
+    float h;
+
+    if (heightMailbox == NULL)
+        return false;
+
+    // Drop whatever is already in the mailbox so the caller gets a fresh frame
+    xQueueReceive(heightMailbox, &h, 0);
+    if (!xQueueReceive(heightMailbox, &h, timeout))
+        return false;
+
+    if (height)
+        *height = h;
+    return true;
 }
 
 void read_distance_mm()
 {
+    // While the DMA stream owns ADC1 just wait for its next height
+    if (streaming)
+    {
+        dist_wait_height(NULL, pdMS_TO_TICKS(DIST_MAX_FRAME_MS * 4));
+        return;
+    }
+
     const int SAMPLE_COUNT = 11;   // 7 samples for median
-    float samples[SAMPLE_COUNT];
 
+    // Fresh median per call, samples are 5 ms apart
+    height_filter_set_window(&filter, SAMPLE_COUNT, 200);
     for (int i = 0; i < SAMPLE_COUNT; i++)
     {
         // Read ADC raw
         uint32_t raw = adc1_get_raw(IR_ADC_CHANNEL);
 
-        // Convert to voltage
-        float voltage = (raw / 4095.0f) * 3.3f;
+        height_filter_sample(&filter, raw);
+        adc_trace_record(esp_timer_get_time(), raw, trace_motor_state(), motor_get_duty() >> 2);
+        poll_count++;
 
-        if (voltage < 0.1f) {
-            samples[i] = -1; // invalid
-        } else {
-            float distance_cm = 12.08f * powf(voltage, -1.058f);
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+
+    adc_trace_mark_frame();
+    publish_frame(poll_count);
+}
+
+static void push_frame(const uint8_t *buf, uint32_t len)
+{
+    // The frame arrives when its last conversion is done, earlier samples
+    // are dated back one sample period each
+    int64_t now = esp_timer_get_time();
+    uint32_t period_us = 1000000 / profile->rate_hz;
+    uint32_t results = len / DIST_RESULT_BYTES;
+    uint8_t motor = trace_motor_state();
+    uint8_t duty = motor_get_duty() >> 2;
+
+    for (uint32_t i = 0; i + DIST_RESULT_BYTES <= len; i += DIST_RESULT_BYTES)
+    {
+        const adc_digi_output_data_t *p = (const adc_digi_output_data_t *)&buf[i];
+
+        if (p->type2.unit != 0 || p->type2.channel != IR_ADC_CHANNEL)
+            continue;
 
-            distance_cm -= 0.20f;  // calibration offset (adjust if needed)
+        raw_ring[raw_count & (DIST_RING_LEN - 1)] = p->type2.data;
+        raw_count++;
 
-            samples[i] = distance_cm;
+        height_filter_sample(&filter, p->type2.data);
+        // The trace keeps the low 32 bits, wrapping like the clock it dumps
+        int64_t t = now - (int64_t)(results - 1 - i / DIST_RESULT_BYTES) * period_us;
+        adc_trace_record((uint32_t)t, p->type2.data, motor, duty);
+    }
+    adc_trace_mark_frame();
+}
+
+// Median raw ADC code at the current position
+static uint16_t capture_raw(void)
+{
+    median_window_t w;
+    float median = 0;
+
+    if (streaming)
+    {
+        // Let the stream refill the whole ring with samples taken from now on
+        vTaskDelay(pdMS_TO_TICKS(DIST_RING_LEN * 1000 / profile->rate_hz + DIST_MAX_FRAME_MS));
+
+        median_window_init(&w, DIST_RING_LEN);
+        for (int i = 0; i < DIST_RING_LEN; i++)
+            median_window_push(&w, raw_ring[i], true);
+    }
+    else
+    {
+        median_window_init(&w, 11);
+        for (int i = 0; i < 11; i++)
+        {
+            median_window_push(&w, adc1_get_raw(IR_ADC_CHANNEL), true);
+            vTaskDelay(pdMS_TO_TICKS(5));
         }
+    }
 
-        vTaskDelay(pdMS_TO_TICKS(5));
+    median_window_get(&w, &median);
+    return (uint16_t)median;
+}
+
+static void store_calibration(void)
+{
+    ir_curve_apply_cal(&ir_cal);
+    save_blob("ir_cal", &ir_cal, sizeof(ir_cal));
+}
+
+// Add a calibration point for a known height at the current position.
+// Parked on a proximity switch the point becomes that switch's endpoint.
+bool dist_cal_capture(float known_height)
+{
+    if (motorRunning)
+        return false;
+
+    uint8_t flags = IR_CAL_POINT;
+    if (gpio_get_level(PROXIMITY_BOTTOM))
+        flags = IR_CAL_BOTTOM;
+    else if (gpio_get_level(PROXIMITY_TOP))
+        flags = IR_CAL_TOP;
+
+    xSemaphoreTake(cal_lock, portMAX_DELAY);
+    bool ok = ir_cal_set_point(&ir_cal, capture_raw(), known_height, flags);
+    if (ok)
+        store_calibration();
+    xSemaphoreGive(cal_lock);
+    return ok;
+}
+
+// Re-capture the raw code on a proximity switch. The switch does not move,
+// so a stored endpoint keeps its height and only its raw code follows the
+// sensor drift. The first capture takes the current reading as the height,
+// i.e. the factory curve's idea of it; every later capture anchors on that,
+// so a wrong first height stays until dist_cal_set_endpoint() corrects it.
+float dist_cal_capture_endpoint(uint8_t which)
+{
+    xSemaphoreTake(cal_lock, portMAX_DELAY);
+    const ir_cal_point_t *p = ir_cal_find(&ir_cal, which);
+    float height = p ? p->height : dist_height();
+
+    if (ir_cal_set_point(&ir_cal, capture_raw(), height, which))
+        store_calibration();
+    xSemaphoreGive(cal_lock);
+
+    return height;
+}
+
+// Correct the height of a captured endpoint, e.g. measured with a rule.
+// Its raw code stays; the limit at that end moves by the same amount.
+// motor_task is the only writer of the live limits, it is handed the shift.
+bool dist_cal_set_endpoint(uint8_t which, float height)
+{
+    if (motorRunning)
+        return false;
+
+    xSemaphoreTake(cal_lock, portMAX_DELAY);
+    const ir_cal_point_t *p = ir_cal_find(&ir_cal, which);
+    float delta = p ? height - p->height : 0;
+    bool ok = p && ir_cal_set_point(&ir_cal, p->raw, height, which);
+    if (ok)
+        store_calibration();
+    xSemaphoreGive(cal_lock);
+
+    if (ok)
+        motor_shift_limit(which == IR_CAL_TOP, delta);
+    return ok;
+}
+
+void dist_cal_clear(void)
+{
+    xSemaphoreTake(cal_lock, portMAX_DELAY);
+    ir_cal_clear(&ir_cal);
+    store_calibration();
+    xSemaphoreGive(cal_lock);
+}
+
+// Legacy blocking sampling, only used when the DMA driver cannot be started
+static void distance_poll_task(void *arg)
+{
+    while (1)
+    {
+        read_distance_mm();
+        vTaskDelay(pdMS_TO_TICKS(200));
     }
+}
 
-    // Step 1: median filter removes outliers
-    float median_value = median_filter(samples, SAMPLE_COUNT);
+// Motor start/stop hook, the sampler switches profile after its current frame
+void dist_set_profile(dist_profile_t p)
+{
+    if (distTaskHandle)
+        xTaskNotify(distTaskHandle, p + 1, eSetValueWithOverwrite);
+}
 
-    // Step 2: smooth (low-pass filter)
-    float stable_value = smooth(median_value);
-    stable_value = roundf(stable_value * 10.0f) / 10.0f;
-    current_height_mm = stable_value;
+// ADC1 back to one-shot reads for good. The stream must already be down:
+// with the driver deinitialised adc_digi_read_bytes() and adc_digi_stop()
+// dereference its freed context.
+static void fall_back_to_polling(void)
+{
+    streaming = false;
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten(IR_ADC_CHANNEL, ADC_ATTEN_DB_11);
+    distance_poll_task(NULL); // does not return
 }
 
+// Returns false when neither the new nor the previous profile restarts
+// the stream, the driver is deinitialised then
+static bool switch_profile(const dist_profile_cfg_t *next)
+{
+    const dist_profile_cfg_t *prev = profile;
+
+    adc_stream_stop();
+    profile = next;
+    if (!adc_stream_start(profile))
+    {
+        printf("ADC profile switch failed, keeping previous rate\n");
+        profile = prev;
+        if (!adc_stream_start(profile))
+            return false;
+    }
+
+    height_filter_set_window(&filter, profile->window, profile->rate_hz);
+    return true;
+}
 
 void distance_task(void *arg)
 {
+    static uint8_t frame[DIST_MAX_FRAME * DIST_RESULT_BYTES];
+    uint32_t len = 0;
+    uint32_t request = 0;
+    int failures = 0;
+
+    height_filter_set_window(&filter, profile->window, profile->rate_hz);
 
     while (1)
     {
-        read_distance_mm();
+        // Profile change requested by the motor code since the last frame
+        if (xTaskNotifyWait(0, UINT32_MAX, &request, 0) && request > 0 &&
+            &profiles[request - 1] != profile)
+        {
+            if (!switch_profile(&profiles[request - 1]))
+            {
+                printf("ADC stream did not restart, falling back to polling\n");
+                fall_back_to_polling();
+            }
+        }
 
-        // Optional debug print
-        // printf("Height = %.1f mm\n", current_height_mm);
+        // Blocks until the DMA engine hands over one frame of conversions
+        esp_err_t ret = adc_digi_read_bytes(frame, profile->frame * DIST_RESULT_BYTES, &len, ADC_MAX_DELAY);
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) // INVALID_STATE = driver buffer overrun, data still usable
+        {
+            // Back off instead of spinning a priority-5 task. A stream that
+            // keeps failing hands ADC1 over to the polling path for good.
+            if (++failures >= DIST_READ_FAILS)
+            {
+                printf("ADC stream keeps failing (%d), falling back to polling\n", ret);
+                adc_stream_stop();
+                fall_back_to_polling();
+            }
+            vTaskDelay(pdMS_TO_TICKS(DIST_READ_FAIL_MS));
+            continue;
+        }
+        failures = 0;
 
-        vTaskDelay(pdMS_TO_TICKS(200)); // 20 Hz update rate
+        push_frame(frame, len);
+        publish_frame(raw_count);
+
+        // Optional debug print
+        // printf("Height = %.1f mm\n", dist_height());
     }
 }
 
 void start_distance_task()
 {
-    xTaskCreate(distance_task, "distance_task", 2048, NULL, 5, NULL);
+    heightMailbox = xQueueCreate(1, sizeof(float));
+
+    streaming = adc_stream_start(profile);
+    if (!streaming)
+    {
+        printf("ADC continuous mode failed, falling back to polling\n");
+        xTaskCreate(distance_poll_task, "distance_task", 2048, NULL, 5, NULL);
+        return;
+    }
+
+    xTaskCreate(distance_task, "distance_task", 3072, NULL, 5, &distTaskHandle);
 }
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include "PC_DATA.h"
 #include "DWIN_HMI.h"
+#include "dist.h"
+#include "adcTrace.h"
+#include "traceDump.h"
+#include "motionTrace.h"
+#include "Daly_BMS.h"
+#include "motorControl.h"
 
 #define BUF_SIZE 256
 #define FRAME_MAX_LEN 32
@@ -96,6 +102,22 @@ static void parseBinaryData(uint8_t *rx, int len)
                 frame[index++] = byte;
                 state = RX_COLLECT_FRAME;
             }
+            else if (byte == CAL_POINT_MARKER)
+            {
+                marker = byte;
+                expected_len = CAL_POINT_LEN;
+                index = 0;
+                frame[index++] = byte;
+                state = RX_COLLECT_FRAME;
+            }
+            else if (byte == TRACE_MARKER)
+            {
+                marker = byte;
+                expected_len = TRACE_LEN;
+                index = 0;
+                frame[index++] = byte;
+                state = RX_COLLECT_FRAME;
+            }
             break;
 
         case RX_COLLECT_FRAME:
@@ -147,6 +169,97 @@ static void parseBinaryData(uint8_t *rx, int len)
 
                         display_device_name(0x1800, newName);
                     }
+
+                    /* ---- SENSOR CALIBRATION POINT ---- */
+                    else if (marker == CAL_POINT_MARKER)
+                    {
+                        bool ok = false;
+
+                        if (frame[1] == CAL_OP_CAPTURE)
+                        {
+                            float height = ((frame[2] << 8) | frame[3]) / 100.0f;
+                            ok = dist_cal_capture(height);
+                        }
+                        else if (frame[1] == CAL_OP_CLEAR)
+                        {
+                            dist_cal_clear();
+                            ok = true;
+                        }
+                        else if (frame[1] == CAL_OP_BOTTOM || frame[1] == CAL_OP_TOP)
+                        {
+                            float height = ((frame[2] << 8) | frame[3]) / 100.0f;
+                            ok = dist_cal_set_endpoint(frame[1] == CAL_OP_TOP ? IR_CAL_TOP : IR_CAL_BOTTOM, height);
+                        }
+
+                        const char *reply = ok ? "cal,ok\r\n" : "cal,fail\r\n";
+                        uart_write_bytes(PC_UART, reply, strlen(reply));
+                    }
+
+                    /* ---- RAW ADC / MOTION TRACE ---- */
+                    else if (marker == TRACE_MARKER)
+                    {
+                        bool ok = false;
+
+                        // Erasing flash stalls the cache of both cores; a moving
+                        // column would lose its ticks to it, so saves wait for rest
+                        if ((frame[1] == TRACE_OP_SAVE || frame[1] == TRACE_OP_MOTION_SAVE) && motorRunning)
+                            ok = false;
+                        else if (frame[1] == TRACE_OP_START)
+                            ok = adc_trace_start();
+                        else if (frame[1] == TRACE_OP_STOP)
+                        {
+                            adc_trace_stop();
+                            ok = true;
+                        }
+                        else if (frame[1] == TRACE_OP_DUMP)
+                            ok = adc_trace_dump_uart();
+                        else if (frame[1] == TRACE_OP_SAVE)
+                            ok = adc_trace_save();
+                        else if (frame[1] == TRACE_OP_LOAD)
+                            ok = trace_dump_partition();
+                        else if (frame[1] == TRACE_OP_MOTION_DUMP)
+                            ok = motion_trace_dump_uart();
+                        else if (frame[1] == TRACE_OP_MOTION_SAVE)
+                            ok = motion_trace_save();
+                        else if (frame[1] == TRACE_OP_DWIN_STATS)
+                        {
+                            dwin_link_stats_t st;
+                            char line[192];
+
+                            display_get_link_stats(&st);
+                            int n = snprintf(line, sizeof(line),
+                                             "dwin,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\r\n", st.cycles,
+                                             st.last_bytes, st.max_bytes, st.total_bytes, st.frames, st.writes,
+                                             st.suppressed, st.deferred, st.wakeups, st.rx_frames, st.rx_dropped,
+                                             st.acks, st.ack_timeouts, st.retransmits, st.lost);
+                            uart_write_bytes(PC_UART, line, n);
+                            ok = true;
+                        }
+                        else if (frame[1] == TRACE_OP_MOTION_COST)
+                        {
+                            motion_trace_cost_t c;
+                            char line[96];
+
+                            motion_trace_get_cost(&c);
+                            int n = snprintf(line, sizeof(line), "mtrace,%u,%u,%u,%u,%u\r\n", c.count, c.last,
+                                             c.max, c.count ? (unsigned)(c.total / c.count) : 0, c.over);
+                            uart_write_bytes(PC_UART, line, n);
+                            ok = true;
+                        }
+                        else if (frame[1] == TRACE_OP_POWER)
+                        {
+                            char line[96];
+
+                            int n = snprintf(line, sizeof(line), "power,%.0f,%d,%d,%.1f,%d,%d\r\n",
+                                             powerEnvelope.share * 100, powerEnvelope.locked, powerEnvelope.hot,
+                                             g_pack.pack_soc, g_temp.min_temp, g_temp.max_temp);
+                            uart_write_bytes(PC_UART, line, n);
+                            ok = true;
+                        }
+
+                        const char *reply = ok ? "trace,ok\r\n" : "trace,fail\r\n";
+                        uart_write_bytes(PC_UART, reply, strlen(reply));
+                    }
                 }
 
                 // Reset for next frame
@@ -6,16 +6,36 @@
 #include "string.h"
 
 extern bool pcConnected;
-extern bool calibrating;
+extern volatile bool calibrating;
 extern QueueHandle_t pcQueue;
 
 #define PC_UART UART_NUM_0
 
 #define SYSTEM_METRICS_MARKER   0xAA
 #define DEVICE_NAME_MARKER     0xBB
+#define CAL_POINT_MARKER       0xCC
+#define TRACE_MARKER           0xDD
 
 #define SYS_METRICS_LEN   10   // 1 + 8 + 1
 #define DEV_NAME_LEN     22   // 1 + 20 + 1
+#define CAL_POINT_LEN     5    // 1 + op + height(2, x100) + 1
+#define TRACE_LEN         3    // 1 + op + 1
+
+#define CAL_OP_CAPTURE    0x01 // add a point for the given height at the current position
+#define CAL_OP_CLEAR      0x02 // drop all points, back to the factory curve
+#define CAL_OP_BOTTOM     0x03 // correct the height of the captured bottom endpoint
+#define CAL_OP_TOP        0x04 // correct the height of the captured top endpoint
+
+#define TRACE_OP_START    0x01 // start recording raw ADC samples
+#define TRACE_OP_STOP     0x02
+#define TRACE_OP_DUMP     0x03 // stop and send the RAM ring as a TRC1 image
+#define TRACE_OP_SAVE     0x04 // stop and write the RAM ring to the storage partition, refused while the motor runs
+#define TRACE_OP_LOAD     0x05 // send the image saved in the storage partition
+#define TRACE_OP_MOTION_DUMP 0x06 // send the motion tick ring as a TRC1 image, recording carries on
+#define TRACE_OP_MOTION_SAVE 0x07 // write the motion tick ring to the storage partition, refused while the motor runs
+#define TRACE_OP_DWIN_STATS  0x08 // reply with the HMI link load as a text line
+#define TRACE_OP_MOTION_COST 0x09 // reply with the CPU cycles a motion trace record takes as a text line
+#define TRACE_OP_POWER       0x0A // reply with the power envelope and the pack readings it follows as a text line
 
 typedef enum {
     RX_WAIT_MARKER,
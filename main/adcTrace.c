@@ -0,0 +1,128 @@
+#include "adcTrace.h"
+#include "traceDump.h"
+#include "stdlib.h"
+#include "stdio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static adc_trace_rec_t *ring = NULL;
+static uint32_t head = 0;                  // records written since the start
+static volatile bool active = false;
+static volatile bool writing = false;      // sampler inside a record, see quiesce()
+
+// Stop the sampler writing and wait out a record it is part way through.
+// The sampler raises `writing` before it checks `active`, so once `writing`
+// reads low after `active` was cleared, nothing is in flight and nothing
+// new starts.
+static void quiesce(void)
+{
+    __atomic_store_n(&active, false, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&writing, __ATOMIC_SEQ_CST))
+        vTaskDelay(1);
+}
+
+// Sampler side of the handshake: false when the record must not be written
+static bool record_begin(void)
+{
+    if (!active)
+        return false;
+    __atomic_store_n(&writing, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&active, __ATOMIC_SEQ_CST))
+        return true;
+    __atomic_store_n(&writing, false, __ATOMIC_RELEASE);
+    return false;
+}
+
+static void record_end(void)
+{
+    __atomic_store_n(&writing, false, __ATOMIC_RELEASE);
+}
+
+// Start a fresh capture, the oldest records are overwritten once the ring is full
+bool adc_trace_start(void)
+{
+    if (ring == NULL)
+        ring = malloc(ADC_TRACE_LEN * sizeof(adc_trace_rec_t));
+
+    if (ring == NULL)
+    {
+        printf("No memory for the ADC trace\n");
+        return false;
+    }
+
+    // head is reset with the sampler held off, and published before it
+    // may write again
+    quiesce();
+    head = 0;
+    __atomic_store_n(&active, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+void adc_trace_stop(void)
+{
+    quiesce();
+}
+
+bool adc_trace_active(void)
+{
+    return active;
+}
+
+// Called by the sampler for every raw code it hands to the filter
+void adc_trace_record(uint32_t timestamp_us, uint16_t raw, uint8_t motor, uint8_t duty)
+{
+    if (!record_begin())
+        return;
+
+    adc_trace_rec_t *r = &ring[head % ADC_TRACE_LEN];
+    r->timestamp_us = timestamp_us;
+    r->raw = raw;
+    r->motor = motor;
+    r->duty = duty;
+    head++;
+    record_end();
+}
+
+// Flag the newest record as the one that closed a filter frame
+void adc_trace_mark_frame(void)
+{
+    if (!record_begin())
+        return;
+    if (head)
+        ring[(head - 1) % ADC_TRACE_LEN].motor |= ADC_TRACE_FRAME_END;
+    record_end();
+}
+
+static int ring_runs(trace_run_t runs[2])
+{
+    if (ring == NULL || head == 0)
+        return 0;
+
+    if (head <= ADC_TRACE_LEN)
+    {
+        runs[0] = (trace_run_t){ring, head};
+        return 1;
+    }
+
+    uint32_t oldest = head % ADC_TRACE_LEN;
+    runs[0] = (trace_run_t){&ring[oldest], ADC_TRACE_LEN - oldest};
+    runs[1] = (trace_run_t){ring, oldest};
+    return oldest ? 2 : 1;
+}
+
+// Both dumps end the capture so the ring cannot move underneath them
+bool adc_trace_dump_uart(void)
+{
+    trace_run_t runs[2];
+
+    adc_trace_stop();
+    return trace_dump_uart(TRACE_TYPE_ADC, sizeof(adc_trace_rec_t), runs, ring_runs(runs));
+}
+
+bool adc_trace_save(void)
+{
+    trace_run_t runs[2];
+
+    adc_trace_stop();
+    return trace_save_partition(TRACE_TYPE_ADC, sizeof(adc_trace_rec_t), runs, ring_runs(runs));
+}
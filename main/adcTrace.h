@@ -0,0 +1,27 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+#define ADC_TRACE_LEN         8192  // records, 64 KB allocated on the first start
+
+// motor byte of a record
+#define ADC_TRACE_DIR_MASK    0x03  // motor_direction_t, 3 = stopped
+#define ADC_TRACE_FRAME_END   0x20  // last sample of a filter frame
+#define ADC_TRACE_MOVING      0x40  // sampled with the moving profile
+#define ADC_TRACE_RUNNING     0x80  // motor was powered
+
+// One raw sample as the filter chain saw it
+typedef struct __attribute__((packed)) {
+    uint32_t timestamp_us;
+    uint16_t raw;
+    uint8_t motor;
+    uint8_t duty;          // LEDC duty >> 2
+} adc_trace_rec_t;
+
+bool adc_trace_start(void);
+void adc_trace_stop(void);
+bool adc_trace_active(void);
+void adc_trace_record(uint32_t timestamp_us, uint16_t raw, uint8_t motor, uint8_t duty);
+void adc_trace_mark_frame(void);
+bool adc_trace_dump_uart(void);
+bool adc_trace_save(void);
@@ -1,3 +1,4 @@
+#pragma once
 #include "stdint.h"
 #include "driver/gpio.h"
 #include "nvs_flash.h"
@@ -9,15 +10,66 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "irCurve.h"
+#include "heightFilter.h"
 
 #define PROXIMITY_TOP 13
 #define PROXIMITY_BOTTOM 14
 #define IR_ADC_CHANNEL ADC1_CHANNEL_2
 
+// Continuous (DMA) sampling of the IR sensor. Two profiles, switched when the
+// motor starts or stops: fast with a short median window while moving, slow
+// with a long window while parked.
+#define DIST_IDLE_RATE_HZ     800   // ADC conversions per second (>= 611 Hz on ESP32-S3)
+#define DIST_IDLE_FRAME       40    // conversions per DMA frame, one height per frame (50 ms)
+#define DIST_IDLE_WINDOW      63    // median window, samples
+#define DIST_MOVING_RATE_HZ   5000
+#define DIST_MOVING_FRAME     50    // 10 ms
+#define DIST_MOVING_WINDOW    25
+#define DIST_MAX_FRAME        50    // largest frame of any profile
+#define DIST_MAX_FRAME_MS     50    // longest frame period of any profile
+#define DIST_RESULT_BYTES     4     // size of one TYPE2 conversion result
+#define DIST_RING_LEN         64    // raw sample ring, power of two
+#define DIST_READ_FAIL_MS     10    // back-off after a failed DMA read
+#define DIST_READ_FAILS       50    // failed reads in a row before the stream is given up for polling
+
+typedef enum {
+    DIST_PROFILE_IDLE,
+    DIST_PROFILE_MOVING
+} dist_profile_t;
+
+#define DIST_LIMIT_LOOKAHEAD_S 0.03f // soft limits trip on the height this far ahead
+
+#define DIST_MIN_CONFIDENCE   60    // motion commands need at least this sensor confidence
+#define DIST_STALE_US         300000 // heights older than this are not acted on (covers the polling fallback)
+
+// Snapshot of the sensor output, read with dist_get_state()
+typedef struct {
+    float height_mm;      // estimated height
+    float velocity_mm_s;  // estimated rate, + is up
+    int64_t timestamp_us; // esp_timer time the height was produced
+    uint32_t sample_count; // ADC samples consumed so far
+    bool valid;           // false while the median window holds no valid sample
+    uint8_t confidence;   // 0-100 from the sensor health monitor
+    uint8_t faults;       // SENSOR_FAULT_* seen in the last frame
+} height_state_t;
+
 
-extern float bottom_limit_mm,top_limit_mm,center_mm;
 void adc_init();
+void dist_get_state(height_state_t *out);
+bool dist_state_fresh(const height_state_t *s, int64_t max_age_us);
+bool dist_sensor_trusted(void);
+float dist_height(void);
+void dist_set_limits(float bottom, float top);
+void dist_get_limits(float *bottom, float *top);
 int8_t hit_bottom_limit();
 int8_t hit_top_limit();
 void start_distance_task();
 void read_distance_mm();
+bool dist_wait_height(float *height, TickType_t timeout);
+void dist_set_profile(dist_profile_t profile);
+void dist_notify_on_change(TaskHandle_t task, uint32_t bits, float step);
+bool dist_cal_capture(float known_height);
+float dist_cal_capture_endpoint(uint8_t which);
+bool dist_cal_set_endpoint(uint8_t which, float height);
+void dist_cal_clear(void);
@@ -0,0 +1,90 @@
+#include "dwinParser.h"
+#include <string.h>
+
+void dwin_parser_init(dwin_parser_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->state = DWIN_RX_WAIT_HEAD1;
+}
+
+static void deliver(dwin_parser_t *p, dwin_frame_fn fn, void *ctx)
+{
+    dwin_frame_t f = {.cmd = p->body[0], .data = &p->body[1], .len = p->len - 1};
+
+    if (f.cmd == DWIN_RX_READ)
+    {
+        if (p->len < 4)
+        {
+            p->dropped++;
+            return;
+        }
+        f.vp = (p->body[1] << 8) | p->body[2];
+        f.words = p->body[3];
+        f.data = &p->body[4];
+        f.len = p->len - 4;
+    }
+    p->frames++;
+    fn(&f, ctx);
+}
+
+void dwin_parser_feed(dwin_parser_t *p, const uint8_t *data, size_t len, dwin_frame_fn fn, void *ctx)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t b = data[i];
+
+        switch (p->state)
+        {
+        case DWIN_RX_WAIT_HEAD1:
+            if (b == DWIN_RX_HEAD1)
+                p->state = DWIN_RX_WAIT_HEAD2;
+            break;
+
+        case DWIN_RX_WAIT_HEAD2:
+            // 5A 5A A5 is a header after a stray byte
+            if (b == DWIN_RX_HEAD2)
+                p->state = DWIN_RX_WAIT_LEN;
+            else if (b != DWIN_RX_HEAD1)
+                p->state = DWIN_RX_WAIT_HEAD1;
+            break;
+
+        case DWIN_RX_WAIT_LEN:
+            if (b == 0 || b > DWIN_RX_BODY_MAX)
+            {
+                p->dropped++;
+                p->state = (b == DWIN_RX_HEAD1) ? DWIN_RX_WAIT_HEAD2 : DWIN_RX_WAIT_HEAD1;
+                break;
+            }
+            p->len = b;
+            p->pos = 0;
+            p->state = DWIN_RX_BODY;
+            break;
+
+        case DWIN_RX_BODY:
+            p->body[p->pos++] = b;
+            if (p->pos == p->len)
+            {
+                p->state = DWIN_RX_WAIT_HEAD1;
+                deliver(p, fn, ctx);
+            }
+            break;
+        }
+    }
+}
+
+// The line went quiet. The display sends a frame in one burst, so a frame
+// still open now lost bytes; drop it rather than let it swallow the next
+// one. Returns true when one was dropped.
+bool dwin_parser_idle(dwin_parser_t *p)
+{
+    if (p->state == DWIN_RX_WAIT_HEAD1)
+        return false;
+
+    // A lone 5A is no frame yet
+    bool dropped = (p->state != DWIN_RX_WAIT_HEAD2);
+
+    if (dropped)
+        p->dropped++;
+    p->state = DWIN_RX_WAIT_HEAD1;
+    return dropped;
+}
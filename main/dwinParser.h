@@ -0,0 +1,44 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+
+// Incremental parser for frames from the DWIN display: 5A A5 len body,
+// body is len bytes. Bytes are fed as uart_read_bytes() returns them, so a
+// frame split across reads is put back together. Free of ESP-IDF calls.
+
+#define DWIN_RX_HEAD1 0x5A
+#define DWIN_RX_HEAD2 0xA5
+#define DWIN_RX_BODY_MAX 64  // longest body accepted, longer lengths are noise
+#define DWIN_RX_READ 0x83    // VP upload / read reply: vp_hi vp_lo words data
+#define DWIN_RX_WRITE 0x82   // write ACK: "OK"
+
+typedef struct {
+    uint8_t cmd;          // DWIN_RX_READ, DWIN_RX_WRITE, or other
+    uint16_t vp;          // read replies only
+    uint8_t words;        // read replies only, word count the display reported
+    const uint8_t *data;  // after the header fields, valid during the callback
+    uint8_t len;          // bytes at data
+} dwin_frame_t;
+
+typedef void (*dwin_frame_fn)(const dwin_frame_t *f, void *ctx);
+
+typedef enum {
+    DWIN_RX_WAIT_HEAD1,
+    DWIN_RX_WAIT_HEAD2,
+    DWIN_RX_WAIT_LEN,
+    DWIN_RX_BODY
+} dwin_rx_state_t;
+
+typedef struct {
+    dwin_rx_state_t state;
+    uint8_t len;
+    uint8_t pos;
+    uint8_t body[DWIN_RX_BODY_MAX];
+    uint32_t frames;   // complete frames handed out
+    uint32_t dropped;  // frames cut short by an idle gap, bad lengths, short read replies
+} dwin_parser_t;
+
+void dwin_parser_init(dwin_parser_t *p);
+void dwin_parser_feed(dwin_parser_t *p, const uint8_t *data, size_t len, dwin_frame_fn fn, void *ctx);
+bool dwin_parser_idle(dwin_parser_t *p);
@@ -0,0 +1,218 @@
+#include "dwinShadow.h"
+#include <string.h>
+
+// The display content is unknown at boot, every field goes out once
+void dwin_shadow_init(dwin_shadow_t *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+static dwin_shadow_entry_t *find_or_add(dwin_shadow_t *s, uint16_t addr)
+{
+    int i = 0;
+
+    while (i < s->count && s->entry[i].addr < addr)
+        i++;
+    if (i < s->count && s->entry[i].addr == addr)
+        return &s->entry[i];
+    if (s->count == DWIN_SHADOW_ENTRIES)
+        return NULL;
+
+    memmove(&s->entry[i + 1], &s->entry[i], (s->count - i) * sizeof(s->entry[0]));
+    memset(&s->entry[i], 0, sizeof(s->entry[0]));
+    s->entry[i].addr = addr;
+    s->count++;
+    return &s->entry[i];
+}
+
+dwin_shadow_result_t dwin_shadow_write(dwin_shadow_t *s, uint16_t addr, const void *data, size_t len)
+{
+    if (len == 0 || len > DWIN_SHADOW_FIELD_MAX)
+        return DWIN_SHADOW_FULL;
+
+    dwin_shadow_entry_t *e = find_or_add(s, addr);
+    if (e == NULL)
+        return DWIN_SHADOW_FULL;
+
+    s->writes++;
+    if (e->len == len && memcmp(e->data, data, len) == 0)
+    {
+        s->suppressed++;
+        return DWIN_SHADOW_SAME;
+    }
+    memcpy(e->data, data, len);
+    e->len = len;
+    return DWIN_SHADOW_CHANGED;
+}
+
+// The display lost its content (reset, reconnect): resend everything
+void dwin_shadow_forget(dwin_shadow_t *s)
+{
+    for (int i = 0; i < s->count; i++)
+        s->entry[i].known = false;
+}
+
+// Bytes of the field that differ from the display, [lo, hi). A range
+// starts on a word and only ends on an odd byte at the end of the field.
+static bool dirty_range(const dwin_shadow_entry_t *e, uint8_t *lo, uint8_t *hi)
+{
+    if (e->len == 0)
+        return false;
+
+    if (!e->known || e->len != e->sent_len)
+    {
+        *lo = 0;
+        *hi = e->len;
+        return true;
+    }
+
+    int first = -1, last = -1;
+    for (int i = 0; i < e->len; i++)
+    {
+        if (e->data[i] != e->sent[i])
+        {
+            if (first < 0)
+                first = i;
+            last = i;
+        }
+    }
+    if (first < 0)
+        return false;
+
+    *lo = first & ~1;
+    *hi = last + 1;
+    if ((*hi & 1) && *hi < e->len)
+        (*hi)++;
+    return true;
+}
+
+// Display bytes [from, to), byte addresses, as far as the shadow knows them
+static bool fill_gap(const dwin_shadow_t *s, uint32_t from, uint32_t to, uint8_t *dst)
+{
+    for (uint32_t b = from; b < to; b++)
+    {
+        bool found = false;
+
+        for (int i = 0; i < s->count && !found; i++)
+        {
+            const dwin_shadow_entry_t *e = &s->entry[i];
+            uint32_t base = 2u * e->addr;
+
+            if (e->known && b >= base && b < base + e->sent_len)
+            {
+                *dst++ = e->sent[b - base];
+                found = true;
+            }
+        }
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+bool dwin_shadow_dirty(const dwin_shadow_t *s)
+{
+    uint8_t lo, hi;
+
+    for (int i = 0; i < s->count; i++)
+    {
+        if (dirty_range(&s->entry[i], &lo, &hi))
+            return true;
+    }
+    return false;
+}
+
+// Send one frame, entries first..last (in flush order) are on the display then
+static size_t emit(dwin_shadow_t *s, uint8_t *frame, uint32_t start, size_t n, int first, int last,
+                   dwin_send_fn send, void *ctx)
+{
+    uint16_t word = start / 2;
+
+    frame[0] = 0x5A;
+    frame[1] = 0xA5;
+    frame[2] = (uint8_t)(n + 3);
+    frame[3] = 0x82;
+    frame[4] = word >> 8;
+    frame[5] = word & 0xFF;
+    send(frame, DWIN_FRAME_HEADER + n, ctx);
+    s->frames++;
+
+    for (int k = first; k <= last; k++)
+    {
+        dwin_shadow_entry_t *e = &s->entry[k % s->count];
+
+        memcpy(e->sent, e->data, e->len);
+        e->sent_len = e->len;
+        e->known = true;
+    }
+    return DWIN_FRAME_HEADER + n;
+}
+
+// The first frame always goes, a budget below one frame must not stall the link
+static bool over_budget(size_t total, size_t n, size_t budget)
+{
+    return total > 0 && total + DWIN_FRAME_HEADER + n > budget;
+}
+
+// Send what changed since the last flush, at most `budget` bytes. What does
+// not fit stays dirty for the next flush, which starts there. Returns the
+// bytes written.
+size_t dwin_shadow_flush(dwin_shadow_t *s, size_t budget, dwin_send_fn send, void *ctx)
+{
+    uint8_t frame[DWIN_FRAME_HEADER + DWIN_FRAME_DATA_MAX];
+    uint8_t *data = &frame[DWIN_FRAME_HEADER];
+    uint32_t start = 0; // byte address of data[0]
+    size_t n = 0, total = 0;
+    int first = 0;      // flush-order position of the first entry in the frame
+    int base = s->next < s->count ? s->next : 0;
+
+    for (int k = 0; k < s->count; k++)
+    {
+        dwin_shadow_entry_t *e = &s->entry[(base + k) % s->count];
+        uint8_t lo, hi;
+
+        if (!dirty_range(e, &lo, &hi))
+            continue;
+
+        uint32_t from = 2u * e->addr + lo, to = 2u * e->addr + hi;
+
+        // Joins only run up the addresses, the wrap back to 0 starts a frame
+        if (n > 0)
+        {
+            uint32_t end = start + n;
+            bool join = !(end & 1) && from >= end && from - end <= DWIN_COALESCE_GAP &&
+                        to - start <= DWIN_FRAME_DATA_MAX && fill_gap(s, end, from, &data[n]);
+
+            if (!join)
+            {
+                if (over_budget(total, n, budget))
+                {
+                    s->next = (base + first) % s->count;
+                    return total;
+                }
+                total += emit(s, frame, start, n, base + first, base + k - 1, send, ctx);
+                n = 0;
+            }
+        }
+        if (n == 0)
+        {
+            start = from;
+            first = k;
+        }
+
+        memcpy(&data[from - start], &e->data[lo], hi - lo);
+        n = to - start;
+    }
+
+    if (n > 0)
+    {
+        if (over_budget(total, n, budget))
+        {
+            s->next = (base + first) % s->count;
+            return total;
+        }
+        total += emit(s, frame, start, n, base + first, base + s->count - 1, send, ctx);
+    }
+    s->next = 0;
+    return total;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+
+// RAM copy of every VP the firmware writes on the DWIN display. Writes land
+// in the shadow; a flush sends only the bytes that differ from what the
+// display already shows, as 0x82 write frames, and joins dirty ranges that
+// are contiguous (or a few clean bytes apart) into one frame. Each VP holds
+// its latest value only, so a burst of updates never queues up; a flush
+// stops at a byte budget and the next one resumes where it left off. Page
+// changes and beeps are commands, not state, and bypass it. Free of ESP-IDF
+// calls; display_task flushes it and supplies the UART writer.
+
+#define DWIN_SHADOW_ENTRIES 32
+#define DWIN_SHADOW_FIELD_MAX 24 // bytes of one VP field, texts included
+#define DWIN_FRAME_DATA_MAX 64   // data bytes of one write frame
+#define DWIN_FRAME_HEADER 6      // 5A A5 len 82 addr_hi addr_lo
+#define DWIN_COALESCE_GAP 4      // clean bytes resent to join two ranges, below the header cost
+
+typedef struct {
+    uint16_t addr;                        // VP word address
+    uint8_t len;                          // bytes wanted on the display
+    uint8_t sent_len;                     // bytes the display holds, valid when known
+    bool known;                           // display content matches sent[]
+    uint8_t data[DWIN_SHADOW_FIELD_MAX];  // wanted
+    uint8_t sent[DWIN_SHADOW_FIELD_MAX];  // on the display
+} dwin_shadow_entry_t;
+
+typedef struct {
+    dwin_shadow_entry_t entry[DWIN_SHADOW_ENTRIES]; // sorted by address
+    uint8_t count;
+    uint8_t next;         // entry the next flush starts at, round robin under the budget
+    uint32_t writes;      // field writes requested
+    uint32_t suppressed;  // writes that changed nothing
+    uint32_t frames;      // write frames sent
+} dwin_shadow_t;
+
+typedef enum {
+    DWIN_SHADOW_FULL,    // does not fit the shadow, send it some other way
+    DWIN_SHADOW_SAME,    // the shadow already held this value
+    DWIN_SHADOW_CHANGED  // a flush is due
+} dwin_shadow_result_t;
+
+typedef void (*dwin_send_fn)(const uint8_t *frame, size_t len, void *ctx);
+
+void dwin_shadow_init(dwin_shadow_t *s);
+dwin_shadow_result_t dwin_shadow_write(dwin_shadow_t *s, uint16_t addr, const void *data, size_t len);
+void dwin_shadow_forget(dwin_shadow_t *s);
+bool dwin_shadow_dirty(const dwin_shadow_t *s);
+size_t dwin_shadow_flush(dwin_shadow_t *s, size_t budget, dwin_send_fn send, void *ctx);
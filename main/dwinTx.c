@@ -0,0 +1,122 @@
+#include "dwinTx.h"
+#include <string.h>
+
+void dwin_tx_init(dwin_tx_t *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+bool dwin_tx_room(const dwin_tx_t *t)
+{
+    return t->down || t->unacked < DWIN_TX_WINDOW;
+}
+
+static dwin_tx_frame_t *newest(dwin_tx_t *t, int back)
+{
+    return &t->hist[(t->head + DWIN_TX_HISTORY - 1 - back) % DWIN_TX_HISTORY];
+}
+
+// Everything in flight, this write included, has to clear the wire before
+// its ACK can come. Each write keeps its own deadline: ACKs that keep coming
+// for later writes must not hide one that never will.
+static void track(dwin_tx_t *t, dwin_tx_frame_t *f, int64_t now_us)
+{
+    t->unacked++;
+    t->inflight += f->len;
+    f->due_us = now_us + (int64_t)t->inflight * DWIN_TX_BYTE_US + DWIN_TX_ACK_TIMEOUT_US;
+}
+
+static void clean(dwin_tx_t *t)
+{
+    t->count = 0;
+    t->overflow = false;
+    t->unacked = 0;
+    t->inflight = 0;
+}
+
+// A write went to the UART. Frames longer than DWIN_TX_FRAME_MAX are
+// counted but cannot be replayed.
+void dwin_tx_sent(dwin_tx_t *t, const uint8_t *frame, size_t len, bool replay, int64_t now_us)
+{
+    t->sent++;
+    if (t->down)
+        return;
+
+    dwin_tx_frame_t *f = &t->hist[t->head];
+    t->head = (t->head + 1) % DWIN_TX_HISTORY;
+    if (t->count == DWIN_TX_HISTORY)
+        t->overflow = true;
+    else
+        t->count++;
+
+    f->replay = replay && len <= DWIN_TX_FRAME_MAX;
+    f->len = len <= DWIN_TX_FRAME_MAX ? len : 0;
+    memcpy(f->data, frame, f->len);
+    track(t, f, now_us);
+}
+
+// An OK from the panel, taken for the oldest write outstanding. Returns
+// true when it is the first sign of a panel that had gone away; everything
+// written meanwhile went untracked, the caller resends its state.
+bool dwin_tx_ack(dwin_tx_t *t)
+{
+    t->retries = 0;
+    if (t->down)
+    {
+        t->down = false;
+        clean(t);
+        return true;
+    }
+    if (t->unacked == 0)
+    {
+        t->stray++;
+        return false;
+    }
+
+    dwin_tx_frame_t *f = newest(t, t->unacked - 1);
+    t->acks++;
+    t->unacked--;
+    t->inflight -= (f->len < t->inflight) ? f->len : t->inflight;
+    if (t->unacked == 0)
+        clean(t); // every write since the last clean point arrived
+    return false;
+}
+
+// Check the ACK deadline, resend on a timeout
+dwin_tx_result_t dwin_tx_poll(dwin_tx_t *t, int64_t now_us, dwin_tx_send_fn send, void *ctx)
+{
+    if (t->down || t->unacked == 0 || now_us < newest(t, t->unacked - 1)->due_us)
+        return DWIN_TX_OK;
+
+    t->timeouts++;
+    if (++t->retries > DWIN_TX_RETRIES)
+    {
+        t->down = true;
+        t->lost++;
+        clean(t);
+        return DWIN_TX_LOST;
+    }
+    if (t->overflow)
+    {
+        t->lost++;
+        clean(t);
+        return DWIN_TX_LOST;
+    }
+
+    // Any write since the clean point may be the one the panel dropped
+    t->unacked = 0;
+    t->inflight = 0;
+    for (int back = t->count - 1; back >= 0; back--)
+    {
+        dwin_tx_frame_t *f = newest(t, back);
+
+        if (!f->replay)
+            continue;
+        send(f->data, f->len, ctx);
+        t->retransmits++;
+        track(t, f, now_us);
+    }
+    if (t->unacked == 0)
+        clean(t);
+    return DWIN_TX_RESENT;
+}
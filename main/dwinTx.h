@@ -0,0 +1,58 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+
+// Write acknowledgement tracking for the DWIN link. The panel answers every
+// 0x82 write with 4F 4B, in order, but the reply names no frame: when one
+// write is corrupted on the wire the next one's ACK is taken for it and the
+// loss only shows as a missing ACK at the end. Up to DWIN_TX_WINDOW writes
+// are in flight at once; on a timeout every write since the link was last
+// fully acknowledged is sent again (go-back-N over that history). VP and
+// page writes are idempotent, beeps and resets are tracked but never sent
+// twice. Free of ESP-IDF calls; the caller supplies the clock and the writer.
+
+#define DWIN_TX_WINDOW 4             // writes in flight before the sender waits
+#define DWIN_TX_HISTORY 16           // writes kept since the link was last fully acknowledged
+#define DWIN_TX_FRAME_MAX 72         // largest write frame
+#define DWIN_TX_BYTE_US 1042         // one byte at 9600 baud, 8N1
+#define DWIN_TX_ACK_TIMEOUT_US 50000 // panel reply time, on top of the wire time in flight
+#define DWIN_TX_RETRIES 3            // timeouts in a row before the panel counts as gone
+
+typedef struct {
+    int64_t due_us; // its ACK is late after this
+    uint8_t len;
+    bool replay;    // safe to send twice
+    uint8_t data[DWIN_TX_FRAME_MAX];
+} dwin_tx_frame_t;
+
+typedef struct {
+    dwin_tx_frame_t hist[DWIN_TX_HISTORY]; // ring, newest at head - 1
+    uint8_t head;
+    uint8_t count;         // writes kept since the last clean point
+    bool overflow;         // more writes than hist since then, a replay cannot cover them
+    uint8_t unacked;       // newest writes still waiting for their ACK
+    uint32_t inflight;     // bytes of those
+    uint8_t retries;       // timeouts since the last ACK
+    bool down;             // panel not answering, writes go out untracked
+    uint32_t sent;
+    uint32_t acks;
+    uint32_t stray;        // ACKs with nothing outstanding
+    uint32_t timeouts;
+    uint32_t retransmits;  // frames sent again
+    uint32_t lost;         // timeouts a replay could not cover
+} dwin_tx_t;
+
+typedef enum {
+    DWIN_TX_OK,
+    DWIN_TX_RESENT,  // timeout, the history went out again
+    DWIN_TX_LOST     // writes lost for good, the caller resends its state
+} dwin_tx_result_t;
+
+typedef void (*dwin_tx_send_fn)(const uint8_t *frame, size_t len, void *ctx);
+
+void dwin_tx_init(dwin_tx_t *t);
+bool dwin_tx_room(const dwin_tx_t *t);
+void dwin_tx_sent(dwin_tx_t *t, const uint8_t *frame, size_t len, bool replay, int64_t now_us);
+bool dwin_tx_ack(dwin_tx_t *t);
+dwin_tx_result_t dwin_tx_poll(dwin_tx_t *t, int64_t now_us, dwin_tx_send_fn send, void *ctx);
@@ -0,0 +1,51 @@
+#include "heightEstimator.h"
+
+void height_estimator_init(height_estimator_t *e, float alpha, float beta, float tau)
+{
+    e->height = 0;
+    e->velocity = 0;
+    e->alpha = alpha;
+    e->beta = beta;
+    e->tau = tau;
+    e->initialized = false;
+}
+
+void height_estimator_reset(height_estimator_t *e, float height)
+{
+    e->height = height;
+    e->velocity = 0;
+    e->initialized = true;
+}
+
+void height_estimator_predict(height_estimator_t *e, float commanded_velocity, float dt)
+{
+    if (!e->initialized || dt <= 0)
+        return;
+
+    // Motor speed relaxes towards the commanded velocity (first order lag)
+    float k = (e->tau > dt) ? dt / e->tau : 1.0f;
+
+    e->height += e->velocity * dt;
+    e->velocity += (commanded_velocity - e->velocity) * k;
+}
+
+void height_estimator_update(height_estimator_t *e, float measured, float dt)
+{
+    if (!e->initialized)
+    {
+        height_estimator_reset(e, measured); // start from real reading
+        return;
+    }
+
+    float residual = measured - e->height;
+
+    e->height += e->alpha * residual;
+    if (dt > 0)
+        e->velocity += (e->beta / dt) * residual;
+}
+
+// Height extrapolated `lead` seconds past the last update
+float height_estimator_ahead(const height_estimator_t *e, float lead)
+{
+    return e->height + e->velocity * lead;
+}
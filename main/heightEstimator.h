@@ -0,0 +1,23 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// Alpha-beta tracker for column height and velocity.
+// The predict step uses the commanded motor velocity as control input, so
+// the estimate follows a start/stop immediately instead of waiting for the
+// filtered measurements to catch up.
+
+typedef struct {
+    float height;   // estimated height
+    float velocity; // estimated rate, height units per second
+    float alpha;    // position correction gain
+    float beta;     // velocity correction gain
+    float tau;      // motor velocity time constant, seconds
+    bool initialized;
+} height_estimator_t;
+
+void height_estimator_init(height_estimator_t *e, float alpha, float beta, float tau);
+void height_estimator_reset(height_estimator_t *e, float height);
+void height_estimator_predict(height_estimator_t *e, float commanded_velocity, float dt);
+void height_estimator_update(height_estimator_t *e, float measured, float dt);
+float height_estimator_ahead(const height_estimator_t *e, float lead);
@@ -0,0 +1,57 @@
+#include "heightFilter.h"
+
+void height_filter_init(height_filter_t *f, uint8_t window, uint32_t rate_hz)
+{
+    height_estimator_init(&f->estimator, DIST_EST_ALPHA, DIST_EST_BETA, DIST_EST_TAU_S);
+    sensor_health_init(&f->health);
+    height_filter_set_window(f, window, rate_hz);
+}
+
+// Restart the median with a new length, the estimator keeps tracking
+void height_filter_set_window(height_filter_t *f, uint8_t window, uint32_t rate_hz)
+{
+    median_window_init(&f->window, window);
+    f->median_delay_s = window / 2.0f / rate_hz;
+}
+
+void height_filter_sample(height_filter_t *f, uint16_t raw)
+{
+    // Fixed-point table lookup, -1 when the voltage is below the valid range
+    float distance = ir_curve_distance(raw);
+
+    // Step 1: median filter removes outliers, invalid samples never enter it
+    median_window_push(&f->window, distance, distance >= 0);
+    sensor_health_sample(&f->health, raw, distance);
+}
+
+// Close a frame of samples taken over `dt` seconds while the motor was driven
+// at `commanded_velocity`. False when the window holds no valid sample.
+bool height_filter_frame(height_filter_t *f, float commanded_velocity, float dt, float *height)
+{
+    float median;
+
+    if (!median_window_get(&f->window, &median))
+    {
+        sensor_health_frame(&f->health, 0, 0);
+        return false;
+    }
+
+    // Step 2: predict from the motor command, correct with the median
+    float jump = 0;
+    if (dt > DIST_EST_MAX_GAP_S)
+    {
+        height_estimator_reset(&f->estimator, median);
+    }
+    else
+    {
+        height_estimator_predict(&f->estimator, commanded_velocity, dt);
+        jump = median - f->estimator.height;
+        height_estimator_update(&f->estimator, median, dt);
+    }
+    sensor_health_frame(&f->health, jump, dt);
+
+    // The median lags by half its window, report where the column is now.
+    // Not rounded: the position loop needs the resolution below 0.1.
+    *height = height_estimator_ahead(&f->estimator, f->median_delay_s);
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+#include "medianFilter.h"
+#include "heightEstimator.h"
+#include "sensorHealth.h"
+#include "irCurve.h"
+
+// Height/velocity estimator
+#define DIST_EST_ALPHA        0.25f // position correction gain
+#define DIST_EST_BETA         0.035f // velocity correction gain
+#define DIST_EST_TAU_S        0.15f // motor spin-up/spin-down time constant
+#define DIST_EST_MAX_GAP_S    0.5f  // restart tracking after a longer gap between heights
+#define DIST_SPEED_UP         0.65f // column speed at full duty going up, per second
+#define DIST_SPEED_DOWN       0.65f // column speed at full duty going down, per second
+
+// The sensor filter chain: raw code -> curve table -> sliding median ->
+// motor-driven alpha-beta estimator, with the health monitor alongside.
+// Free of ESP-IDF calls so the host replay tool runs exactly this code.
+typedef struct {
+    median_window_t window;
+    height_estimator_t estimator;
+    sensor_health_t health;
+    float median_delay_s; // group delay of the median, the output is advanced by it
+} height_filter_t;
+
+void height_filter_init(height_filter_t *f, uint8_t window, uint32_t rate_hz);
+void height_filter_set_window(height_filter_t *f, uint8_t window, uint32_t rate_hz);
+void height_filter_sample(height_filter_t *f, uint16_t raw);
+bool height_filter_frame(height_filter_t *f, float commanded_velocity, float dt, float *height);
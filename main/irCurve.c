@@ -0,0 +1,188 @@
+#include "irCurve.h"
+#include <math.h>
+#include "string.h"
+#include "stdlib.h"
+
+// Two tables so a recalibration can be built while the sampler keeps reading
+static int32_t curve_tables[2][IR_CURVE_POINTS]; // distance at every IR_CURVE_STEP'th code
+static int32_t *volatile curve_q16 = curve_tables[0];
+static uint16_t raw_min = IR_ADC_MAX + 1;  // first valid code, nothing valid until init
+
+// Factory float model, the table is built from it
+float ir_curve_reference(uint16_t raw)
+{
+    float voltage = (raw / 4095.0f) * IR_VREF;
+
+    if (voltage < IR_MIN_VOLTAGE)
+        return -1; // invalid
+
+    return IR_CURVE_A * powf(voltage, IR_CURVE_B) - IR_CURVE_OFFSET;
+}
+
+// Calibration offset to the factory curve at `raw`, O(log k) in the point count
+static float cal_correction(const ir_cal_t *cal, const float *offset, uint16_t raw)
+{
+    int n = cal->count;
+    const ir_cal_point_t *p = cal->point;
+
+    // Flat beyond the outermost points
+    if (raw <= p[0].raw)
+        return offset[0];
+    if (raw >= p[n - 1].raw)
+        return offset[n - 1];
+
+    int lo = 0, hi = n - 1;
+    while (hi - lo > 1)
+    {
+        int mid = (lo + hi) / 2;
+        if (p[mid].raw <= raw)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    float t = (float)(raw - p[lo].raw) / (float)(p[hi].raw - p[lo].raw);
+    return offset[lo] + (offset[hi] - offset[lo]) * t;
+}
+
+static void build_table(int32_t *table, const ir_cal_t *cal)
+{
+    float offset[IR_CAL_MAX_POINTS];
+    bool use_cal = cal && ir_cal_valid(cal) && cal->count > 0;
+
+    if (use_cal)
+    {
+        for (int i = 0; i < cal->count; i++)
+            offset[i] = cal->point[i].height - ir_curve_reference(cal->point[i].raw);
+    }
+
+    for (int i = 0; i < IR_CURVE_POINTS; i++)
+    {
+        // Evaluate the curve below the validity threshold too, the segment
+        // straddling it still needs a left end point to interpolate from
+        uint32_t raw = i * IR_CURVE_STEP;
+        float voltage = (raw / 4095.0f) * IR_VREF;
+        float d = (i == 0) ? 0 : IR_CURVE_A * powf(voltage, IR_CURVE_B) - IR_CURVE_OFFSET;
+
+        if (use_cal)
+            d += cal_correction(cal, offset, raw > IR_ADC_MAX ? IR_ADC_MAX : raw);
+
+        if (i == 0 || d > 32767.0f)
+            table[i] = INT32_MAX;
+        else
+            table[i] = (int32_t)lroundf(d * (1 << IR_CURVE_FRAC_BITS));
+    }
+}
+
+void ir_curve_init(void)
+{
+    raw_min = 0;
+    while (raw_min <= IR_ADC_MAX && ir_curve_reference(raw_min) < 0)
+        raw_min++;
+
+    build_table(curve_tables[0], NULL);
+    curve_q16 = curve_tables[0];
+}
+
+// Rebuild the table from a calibration (NULL = factory curve) and swap it in
+void ir_curve_apply_cal(const ir_cal_t *cal)
+{
+    int32_t *next = (curve_q16 == curve_tables[0]) ? curve_tables[1] : curve_tables[0];
+
+    build_table(next, cal);
+    curve_q16 = next;
+}
+
+// Table lookup with linear interpolation between neighbouring entries
+int32_t ir_curve_q16(uint16_t raw)
+{
+    if (raw > IR_ADC_MAX)
+        raw = IR_ADC_MAX;
+    if (raw < raw_min)
+        return IR_CURVE_INVALID;
+
+    const int32_t *table = curve_q16;
+    uint32_t i = raw >> IR_CURVE_SHIFT;
+    int32_t frac = raw & (IR_CURVE_STEP - 1);
+    int32_t a = table[i];
+    int32_t b = table[i + 1];
+
+    return a + (((b - a) * frac) >> IR_CURVE_SHIFT);
+}
+
+float ir_curve_distance(uint16_t raw)
+{
+    int32_t q = ir_curve_q16(raw);
+
+    if (q == IR_CURVE_INVALID)
+        return -1;
+    return q * (1.0f / (1 << IR_CURVE_FRAC_BITS));
+}
+
+void ir_cal_clear(ir_cal_t *cal)
+{
+    memset(cal, 0, sizeof(*cal));
+    cal->version = IR_CAL_VERSION;
+}
+
+bool ir_cal_valid(const ir_cal_t *cal)
+{
+    if (cal->version != IR_CAL_VERSION || cal->count > IR_CAL_MAX_POINTS)
+        return false;
+
+    for (int i = 1; i < cal->count; i++)
+    {
+        if (cal->point[i].raw <= cal->point[i - 1].raw)
+            return false;
+    }
+    return true;
+}
+
+const ir_cal_point_t *ir_cal_find(const ir_cal_t *cal, uint8_t flags)
+{
+    for (int i = 0; i < cal->count; i++)
+    {
+        if (cal->point[i].flags == flags)
+            return &cal->point[i];
+    }
+    return NULL;
+}
+
+static void cal_remove(ir_cal_t *cal, int i)
+{
+    memmove(&cal->point[i], &cal->point[i + 1], (cal->count - i - 1) * sizeof(ir_cal_point_t));
+    cal->count--;
+}
+
+bool ir_cal_set_point(ir_cal_t *cal, uint16_t raw, float height, uint8_t flags)
+{
+    if (raw < raw_min || raw > IR_ADC_MAX)
+        return false;
+
+    // An endpoint replaces the previous capture of the same switch, any point
+    // replaces captures made at nearly the same position
+    for (int i = cal->count - 1; i >= 0; i--)
+    {
+        const ir_cal_point_t *p = &cal->point[i];
+        bool same_switch = (flags != IR_CAL_POINT && p->flags == flags);
+
+        if (same_switch || abs((int)p->raw - (int)raw) < IR_CAL_MERGE_RAW)
+            cal_remove(cal, i);
+    }
+
+    if (cal->count >= IR_CAL_MAX_POINTS)
+        return false;
+
+    int i = cal->count;
+    while (i > 0 && cal->point[i - 1].raw > raw)
+    {
+        cal->point[i] = cal->point[i - 1];
+        i--;
+    }
+
+    cal->point[i].raw = raw;
+    cal->point[i].flags = flags;
+    cal->point[i].height = height;
+    cal->count++;
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// IR sensor voltage -> distance curve: d = A * v^B - OFFSET
+#define IR_CURVE_A 12.08f
+#define IR_CURVE_B -1.058f
+#define IR_CURVE_OFFSET 0.20f   // calibration offset (adjust if needed)
+#define IR_VREF 3.3f
+#define IR_MIN_VOLTAGE 0.1f     // below this the reading is invalid
+
+#define IR_ADC_MAX 4095
+#define IR_CURVE_SHIFT 4        // one table entry every 16 ADC codes
+#define IR_CURVE_STEP (1 << IR_CURVE_SHIFT)
+#define IR_CURVE_POINTS ((IR_ADC_MAX + 1) / IR_CURVE_STEP + 1)
+#define IR_CURVE_FRAC_BITS 16   // table values are Q16.16
+#define IR_CURVE_INVALID INT32_MIN
+
+// Calibration points: known heights captured at measured raw codes. The
+// difference to the factory curve is interpolated between points and baked
+// into the table, so conversion stays a single lookup.
+#define IR_CAL_VERSION 1
+#define IR_CAL_MAX_POINTS 8
+#define IR_CAL_MERGE_RAW 24     // a capture this close to an existing point replaces it
+
+#define IR_CAL_POINT 0x00       // captured anywhere on the stroke
+#define IR_CAL_BOTTOM 0x01      // captured on the bottom proximity switch
+#define IR_CAL_TOP 0x02         // captured on the top proximity switch
+
+typedef struct {
+    uint16_t raw;   // ADC code at the point
+    uint8_t flags;  // IR_CAL_POINT / IR_CAL_BOTTOM / IR_CAL_TOP
+    float height;   // known height at the point
+} ir_cal_point_t;
+
+typedef struct {
+    uint8_t version;
+    uint8_t count;
+    ir_cal_point_t point[IR_CAL_MAX_POINTS]; // sorted by raw code
+} ir_cal_t;
+
+void ir_curve_init(void);
+float ir_curve_reference(uint16_t raw);
+int32_t ir_curve_q16(uint16_t raw);
+float ir_curve_distance(uint16_t raw);
+void ir_curve_apply_cal(const ir_cal_t *cal);
+
+void ir_cal_clear(ir_cal_t *cal);
+bool ir_cal_valid(const ir_cal_t *cal);
+bool ir_cal_set_point(ir_cal_t *cal, uint16_t raw, float height, uint8_t flags);
+const ir_cal_point_t *ir_cal_find(const ir_cal_t *cal, uint8_t flags);
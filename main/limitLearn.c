@@ -0,0 +1,69 @@
+#include "limitLearn.h"
+#include <math.h>
+
+// `limit` is the endpoint as stored in NVS, -1 when never calibrated
+void limit_learn_init(limit_learner_t *l, const limit_learn_cfg_t *cfg, float limit)
+{
+    l->cfg = cfg;
+    l->limit = limit;
+    l->saved = limit;
+    l->last_save_s = -1;
+    l->outliers = 0;
+}
+
+limit_learn_result_t limit_learn_observe(limit_learner_t *l, float height)
+{
+    const limit_learn_cfg_t *cfg = l->cfg;
+
+    if (l->limit < 0)
+        return LIMIT_LEARN_IGNORED;
+
+    if (fabsf(height - l->limit) <= cfg->gate)
+    {
+        l->outliers = 0;
+        l->limit += (height - l->limit) * cfg->gain;
+        return LIMIT_LEARN_ACCEPTED;
+    }
+
+    // A run of outliers only counts while its readings agree closely
+    if (l->outliers == 0 || fabsf(height - l->outlier) > cfg->gate / 2)
+    {
+        l->outlier = height;
+        l->outliers = 1;
+    }
+    else
+    {
+        l->outliers++;
+        l->outlier += (height - l->outlier) / l->outliers;
+    }
+
+    if (l->outliers < cfg->rebase_count)
+        return LIMIT_LEARN_REJECTED;
+
+    l->limit = l->outlier;
+    l->outliers = 0;
+    return LIMIT_LEARN_REBASED;
+}
+
+// A hit cut at speed parks `coast` past the switch edge, the stored endpoint
+// was captured after a slow approach that ran only `anchor_coast` past it.
+// Returns the height the hit would have parked at after that approach.
+float limit_learn_hit_height(bool top, float height, float coast, float anchor_coast)
+{
+    float extra = coast - anchor_coast;
+
+    return top ? height - extra : height + extra;
+}
+
+bool limit_learn_save_due(const limit_learner_t *l, float now_s)
+{
+    if (l->limit < 0 || fabsf(l->limit - l->saved) < l->cfg->save_delta)
+        return false;
+    return l->last_save_s < 0 || now_s - l->last_save_s >= l->cfg->save_interval_s;
+}
+
+void limit_learn_saved(limit_learner_t *l, float now_s)
+{
+    l->saved = l->limit;
+    l->last_save_s = now_s;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// Online refinement of a stored endpoint from the heights read while parked
+// on its proximity switch after a normal move. Readings far from the
+// estimate are rejected unless several in a row agree with each other (the
+// end really moved), and the NVS copy is only rewritten when it drifted far
+// enough and not more often than a minimum interval. Free of ESP-IDF calls.
+
+typedef struct {
+    float gate;             // readings further than this from the estimate are outliers
+    float gain;             // share of an accepted reading's difference taken in
+    uint8_t rebase_count;   // agreeing outliers in a row that move the estimate outright
+    float save_delta;       // rewrite NVS once the estimate moved this far from it
+    float save_interval_s;  // and at most this often
+} limit_learn_cfg_t;
+
+#define LIMIT_LEARN_CFG_DEFAULT {                                  \
+    .gate = 0.3f, .gain = 0.2f, .rebase_count = 3,                 \
+    .save_delta = 0.03f, .save_interval_s = 600.0f}
+
+typedef enum {
+    LIMIT_LEARN_IGNORED,    // no stored endpoint to refine
+    LIMIT_LEARN_ACCEPTED,
+    LIMIT_LEARN_REJECTED,
+    LIMIT_LEARN_REBASED     // outliers agreed, estimate moved to them
+} limit_learn_result_t;
+
+typedef struct {
+    const limit_learn_cfg_t *cfg;
+    float limit;        // current estimate, -1 = none
+    float saved;        // value last written to NVS
+    float last_save_s;  // time of that write, -1 = never by the learner
+    float outlier;      // mean of the current run of outliers
+    uint8_t outliers;   // length of that run
+} limit_learner_t;
+
+void limit_learn_init(limit_learner_t *l, const limit_learn_cfg_t *cfg, float limit);
+limit_learn_result_t limit_learn_observe(limit_learner_t *l, float height);
+float limit_learn_hit_height(bool top, float height, float coast, float anchor_coast);
+bool limit_learn_save_due(const limit_learner_t *l, float now_s);
+void limit_learn_saved(limit_learner_t *l, float now_s);
@@ -78,7 +78,7 @@ void gpioInit()
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_DISABLE,
         .pull_down_en = GPIO_PULLDOWN_ENABLE,
-        .intr_type = GPIO_INTR_DISABLE};
+        .intr_type = GPIO_INTR_POSEDGE}; // Switch hit cuts the motor from the ISR
     gpio_config(&io_conf);
 
     // Configure Direction pin(EN)
@@ -106,6 +106,8 @@ void app_main(void)
 
     motorQueue = xQueueCreate(10, sizeof(motor_cmd_t));     // Que Creation for Motor
     displayQueue = xQueueCreate(10, sizeof(display_msg_t)); // Que Creation for Display
+    display_init();                                          // HMI field shadow, before anything writes to it
+    power_envelope_init(&powerEnvelope);                     // full power until the BMS answers, before motor_task reads it
     pcQueue = xQueueCreate(10, sizeof(pc_msg_t));
     // Starting Log
     ESP_LOGW("Cow", "V2.1");
@@ -130,8 +132,13 @@ void app_main(void)
     }
 
     // Load Limits from NVS
-    bottom_limit_mm = load_limit("limit_bottom");
-    top_limit_mm = load_limit("limit_top");
+    float bottom_limit_mm = load_limit("limit_bottom");
+    float top_limit_mm = load_limit("limit_top");
+    dist_set_limits(bottom_limit_mm, top_limit_mm);
+    motor_load_model(); // Motion model measured by the last calibration
+
+    start_distance_task(); // Task to find the distance, first calibration steers by it
+
     if (top_limit_mm == -1.0 || bottom_limit_mm == -1.0)
     {
         initial_calib = 1;
@@ -143,8 +150,6 @@ void app_main(void)
 
     start_motor_task(); // Task to run Motors
 
-    start_distance_task(); // Task to find the distance
-
     start_animDisp_task(); // Task to change Display Pages/Themes
 
     start_pc_task(); // Task to Communicate with PC Over UART
@@ -0,0 +1,174 @@
+#include "medianFilter.h"
+#include "string.h"
+
+#define HEAP_NONE 0
+#define HEAP_LOW 1
+#define HEAP_HIGH 2
+
+static inline uint8_t *heap_of(median_window_t *w, uint8_t which, uint8_t **n)
+{
+    if (which == HEAP_LOW)
+    {
+        *n = &w->n_low;
+        return w->low;
+    }
+    *n = &w->n_high;
+    return w->high;
+}
+
+// true if slot a belongs above slot b in the given heap
+static inline bool heap_before(const median_window_t *w, uint8_t which, uint8_t a, uint8_t b)
+{
+    if (which == HEAP_LOW)
+        return w->value[a] > w->value[b];
+    return w->value[a] < w->value[b];
+}
+
+static inline void heap_set(median_window_t *w, uint8_t *heap, uint8_t i, uint8_t slot)
+{
+    heap[i] = slot;
+    w->pos[slot] = i;
+}
+
+static void sift_up(median_window_t *w, uint8_t which, uint8_t i)
+{
+    uint8_t *n;
+    uint8_t *heap = heap_of(w, which, &n);
+    uint8_t slot = heap[i];
+
+    while (i > 0)
+    {
+        uint8_t parent = (i - 1) / 2;
+        if (!heap_before(w, which, slot, heap[parent]))
+            break;
+        heap_set(w, heap, i, heap[parent]);
+        i = parent;
+    }
+    heap_set(w, heap, i, slot);
+}
+
+static void sift_down(median_window_t *w, uint8_t which, uint8_t i)
+{
+    uint8_t *n;
+    uint8_t *heap = heap_of(w, which, &n);
+    uint8_t slot = heap[i];
+
+    while (1)
+    {
+        uint8_t child = 2 * i + 1;
+        if (child >= *n)
+            break;
+        if (child + 1 < *n && heap_before(w, which, heap[child + 1], heap[child]))
+            child++;
+        if (!heap_before(w, which, heap[child], slot))
+            break;
+        heap_set(w, heap, i, heap[child]);
+        i = child;
+    }
+    heap_set(w, heap, i, slot);
+}
+
+static void heap_insert(median_window_t *w, uint8_t which, uint8_t slot)
+{
+    uint8_t *n;
+    uint8_t *heap = heap_of(w, which, &n);
+
+    w->heap_of[slot] = which;
+    heap_set(w, heap, *n, slot);
+    (*n)++;
+    sift_up(w, which, *n - 1);
+}
+
+static void heap_remove(median_window_t *w, uint8_t which, uint8_t i)
+{
+    uint8_t *n;
+    uint8_t *heap = heap_of(w, which, &n);
+
+    w->heap_of[heap[i]] = HEAP_NONE;
+    (*n)--;
+    if (i == *n)
+        return;
+
+    // Move the last element into the hole and restore the heap around it
+    uint8_t moved = heap[*n];
+    heap_set(w, heap, i, moved);
+    sift_up(w, which, i);
+    sift_down(w, which, w->pos[moved]);
+}
+
+static uint8_t heap_pop(median_window_t *w, uint8_t which)
+{
+    uint8_t *n;
+    uint8_t *heap = heap_of(w, which, &n);
+    uint8_t top = heap[0];
+
+    heap_remove(w, which, 0);
+    return top;
+}
+
+// Keep n_low == n_high or n_low == n_high + 1
+static void rebalance(median_window_t *w)
+{
+    while (w->n_low > w->n_high + 1)
+        heap_insert(w, HEAP_HIGH, heap_pop(w, HEAP_LOW));
+
+    while (w->n_high > w->n_low)
+        heap_insert(w, HEAP_LOW, heap_pop(w, HEAP_HIGH));
+}
+
+void median_window_init(median_window_t *w, uint8_t size)
+{
+    memset(w, 0, sizeof(*w));
+    if (size == 0)
+        size = 1;
+    if (size > MEDIAN_WINDOW_MAX)
+        size = MEDIAN_WINDOW_MAX;
+    w->size = size;
+}
+
+void median_window_push(median_window_t *w, float value, bool valid)
+{
+    uint8_t slot = w->head;
+
+    // Evict the sample leaving the window
+    if (w->filled == w->size && w->heap_of[slot] != HEAP_NONE)
+    {
+        heap_remove(w, w->heap_of[slot], w->pos[slot]);
+        rebalance(w);
+    }
+
+    w->value[slot] = value;
+
+    if (valid)
+    {
+        if (w->n_low == 0 || value <= w->value[w->low[0]])
+            heap_insert(w, HEAP_LOW, slot);
+        else
+            heap_insert(w, HEAP_HIGH, slot);
+    }
+    rebalance(w);
+
+    w->head = (slot + 1 == w->size) ? 0 : slot + 1;
+    if (w->filled < w->size)
+        w->filled++;
+}
+
+// Odd count: middle element. Even count: upper middle, same as sorted[n / 2].
+bool median_window_get(const median_window_t *w, float *median)
+{
+    uint8_t count = w->n_low + w->n_high;
+
+    if (count == 0)
+        return false;
+
+    if (count & 1)
+        *median = w->value[w->low[0]];
+    else
+        *median = w->value[w->high[0]];
+    return true;
+}
+
+uint8_t median_window_valid_count(const median_window_t *w)
+{
+    return w->n_low + w->n_high;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// Sliding-window median over the last `size` samples.
+// Valid samples live in two heaps (max-heap for the lower half, min-heap for
+// the upper half), so a push is O(log n) instead of re-sorting the window.
+// Invalid samples still advance the window but never enter the heaps.
+
+#define MEDIAN_WINDOW_MAX 64
+
+typedef struct {
+    float value[MEDIAN_WINDOW_MAX];  // sample stored in each ring slot
+    uint8_t heap_of[MEDIAN_WINDOW_MAX]; // which heap holds the slot (0 = none)
+    uint8_t pos[MEDIAN_WINDOW_MAX];  // index of the slot inside its heap
+    uint8_t low[MEDIAN_WINDOW_MAX];  // max-heap of slots, lower half
+    uint8_t high[MEDIAN_WINDOW_MAX]; // min-heap of slots, upper half
+    uint8_t n_low;
+    uint8_t n_high;
+    uint8_t size;   // window length in samples
+    uint8_t head;   // next slot to overwrite
+    uint8_t filled; // slots written so far (saturates at size)
+} median_window_t;
+
+void median_window_init(median_window_t *w, uint8_t size);
+void median_window_push(median_window_t *w, float value, bool valid);
+bool median_window_get(const median_window_t *w, float *median);
+uint8_t median_window_valid_count(const median_window_t *w);
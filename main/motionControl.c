@@ -0,0 +1,351 @@
+#include "motionControl.h"
+#include <math.h>
+
+static const motion_output_t HOLD = {MOTION_DRIVE_HOLD, 0, 0};
+
+void motion_init(motion_t *m, const position_cfg_t *cfg, const stall_cfg_t *stall, motion_model_t *model)
+{
+    m->state = MOTION_IDLE;
+    m->cfg = cfg;
+    stall_init(&m->stall, stall);
+    m->model = model;
+    model_probe_abort(&m->probe);
+    m->probe.updated = false;
+    m->elapsed_s = 0;
+    m->limit_s = 0;
+    m->started = false;
+}
+
+static void enter(motion_t *m, motion_state_t state, float limit_s)
+{
+    m->state = state;
+    m->elapsed_s = 0;
+    m->limit_s = limit_s;
+    m->started = false;
+    stall_reset(&m->stall);
+}
+
+static motion_output_t drive(motion_drive_t d, int duty, uint8_t events)
+{
+    motion_output_t out = {d, duty, events};
+    return out;
+}
+
+bool motion_calibrating(const motion_t *m)
+{
+    return m->state >= MOTION_CAL_SEEK;
+}
+
+bool motion_busy(const motion_t *m)
+{
+    return m->state != MOTION_IDLE;
+}
+
+// End whatever is running, `how` is a soft or an immediate stop
+static motion_output_t finish(motion_t *m, motion_drive_t how)
+{
+    bool report = (m->state == MOTION_GOTO) || motion_calibrating(m);
+
+    enter(m, MOTION_IDLE, 0);
+    return drive(how, 0, report ? MOTION_EV_FINISHED : 0);
+}
+
+static motion_output_t start_move(motion_t *m, motion_state_t state, float target, const motion_input_t *in)
+{
+    const position_dir_cfg_t *d = (target >= in->height) ? &m->cfg->up : &m->cfg->down;
+
+    position_ctrl_start(&m->ctrl, m->cfg, in->height, in->velocity, target);
+    enter(m, state, fabsf(target - in->height) / d->v_max + MOTION_MOVE_MARGIN_S);
+
+    int duty = position_ctrl_step(&m->ctrl, in->height, in->velocity, 0);
+    return drive(MOTION_DRIVE_DUTY, duty, 0);
+}
+
+// Onto the switch of the current endpoint. The full-duty sweep is a model
+// run too, cut by the switch rather than free.
+static motion_output_t cal_sweep(motion_t *m, const motion_input_t *in)
+{
+    enter(m, MOTION_CAL_SWEEP, MOTION_SWEEP_TIMEOUT_S);
+    m->started = true;
+    if (m->cal_fast)
+        return drive(MOTION_DRIVE_DUTY, m->cal_up ? MOTION_CAL_APPROACH_DUTY : -MOTION_CAL_APPROACH_DUTY, 0);
+    model_probe_start(&m->probe, m->cal_up, in->height);
+    return drive(m->cal_up ? MOTION_DRIVE_UP : MOTION_DRIVE_DOWN, 0, 0);
+}
+
+// Head for the current endpoint: full duty to just short of its stored
+// height, or straight onto the switch when already that close
+static motion_output_t cal_head(motion_t *m, const motion_input_t *in)
+{
+    if (m->cal_fast && in->trusted)
+    {
+        float target = m->cal_up ? m->cal_top - MOTION_CAL_APPROACH : m->cal_bottom + MOTION_CAL_APPROACH;
+        float to_go = m->cal_up ? target - in->height : in->height - target;
+
+        if (to_go > motion_model_coast(m->model, m->cal_up) + m->cfg->tolerance)
+        {
+            enter(m, MOTION_CAL_SEEK, to_go / motion_model_speed(m->model, m->cal_up) + MOTION_MOVE_MARGIN_S);
+            m->started = true;
+            m->seek_target = target;
+            model_probe_start(&m->probe, m->cal_up, in->height);
+            return drive(m->cal_up ? MOTION_DRIVE_UP : MOTION_DRIVE_DOWN, 0, 0);
+        }
+    }
+    return cal_sweep(m, in);
+}
+
+// Parked on the switch: capture it, then the other end or the centre.
+// When the first switch of a calibration from stored endpoints reads where
+// its endpoint was stored, the sensor has not drifted and the trip to the
+// other end is skipped; that endpoint stays as stored.
+static motion_output_t cal_captured(motion_t *m, const motion_input_t *in)
+{
+    model_probe_cut(&m->probe, m->model, in->height, false);
+
+    uint8_t event = m->cal_up ? MOTION_EV_CAL_TOP : MOTION_EV_CAL_BOTTOM;
+    float stored = m->cal_up ? m->cal_top : m->cal_bottom;
+
+    if (m->cal_fast && m->cal_left == 2 && in->trusted && fabsf(in->height - stored) <= MOTION_CAL_AGREE)
+        m->cal_left = 1;
+
+    if (--m->cal_left == 0)
+        enter(m, MOTION_CAL_WAIT_CENTER, 0);
+    else
+    {
+        // Heads for the other end on the next tick, after the capture
+        m->cal_up = !m->cal_up;
+        enter(m, MOTION_CAL_SEEK, 0);
+    }
+    return drive(MOTION_DRIVE_STOP, 0, event);
+}
+
+motion_output_t motion_request(motion_t *m, motion_req_t req, float target, const motion_input_t *in)
+{
+    bool was_goto = (m->state == MOTION_GOTO);
+
+    if (req == MOTION_REQ_STOP)
+        return m->state == MOTION_IDLE ? drive(MOTION_DRIVE_SOFT_STOP, 0, 0) : finish(m, MOTION_DRIVE_SOFT_STOP);
+
+    // Only a stop interrupts a calibration
+    if (motion_calibrating(m))
+        return req == MOTION_REQ_CALIBRATE ? HOLD : drive(MOTION_DRIVE_HOLD, 0, MOTION_EV_REFUSED);
+
+    switch (req)
+    {
+    case MOTION_REQ_JOG_UP:
+    case MOTION_REQ_JOG_DOWN:
+    {
+        bool up = (req == MOTION_REQ_JOG_UP);
+
+        // Pushing into a limit (or a locked pack) just stops, as before
+        if (in->locked || (up ? in->at_top : in->at_bottom))
+            return finish(m, MOTION_DRIVE_STOP);
+
+        // Repeats while the button is held keep the stall window running
+        if (m->state != (up ? MOTION_JOG_UP : MOTION_JOG_DOWN))
+            enter(m, up ? MOTION_JOG_UP : MOTION_JOG_DOWN, 0);
+        return drive(up ? MOTION_DRIVE_UP : MOTION_DRIVE_DOWN, 0, was_goto ? MOTION_EV_FINISHED : 0);
+    }
+
+    case MOTION_REQ_GOTO:
+        if (in->locked || !in->trusted)
+            return drive(MOTION_DRIVE_HOLD, 0, MOTION_EV_REFUSED);
+        return start_move(m, MOTION_GOTO, target, in);
+
+    case MOTION_REQ_CALIBRATE:
+        if (in->locked)
+            return drive(MOTION_DRIVE_HOLD, 0, MOTION_EV_REFUSED);
+
+        // With stored endpoints, seek fast to each and creep onto the
+        // switch, nearer end first. Without, sweep the full stroke.
+        m->cal_fast = in->trusted && in->limit_bottom >= 0 &&
+                      in->limit_top > in->limit_bottom + 2 * MOTION_CAL_APPROACH;
+        m->cal_up = m->cal_fast && (in->limit_top - in->height < in->height - in->limit_bottom);
+        m->cal_left = 2;
+        m->cal_speed = 0;
+        m->cal_bottom = in->limit_bottom;
+        m->cal_top = in->limit_top;
+        return cal_head(m, in);
+
+    default:
+        return HOLD;
+    }
+}
+
+// Both endpoints are captured, drive to mid stroke to finish the calibration
+motion_output_t motion_cal_center(motion_t *m, float center, const motion_input_t *in)
+{
+    if (m->state != MOTION_CAL_WAIT_CENTER)
+        return HOLD;
+    if (!in->trusted)
+        return finish(m, MOTION_DRIVE_STOP);
+    return start_move(m, MOTION_CAL_CENTER, center, in);
+}
+
+// Feed the stall detector, only while the height can be believed
+static bool stalled(motion_t *m, const motion_input_t *in)
+{
+    if (!in->trusted)
+    {
+        stall_reset(&m->stall);
+        return false;
+    }
+    return stall_update(&m->stall, in->commanded_velocity, in->velocity, in->height, in->dt);
+}
+
+// Stop on a stall, then back away from the obstruction if configured
+static motion_output_t on_stall(motion_t *m, const motion_input_t *in)
+{
+    const stall_cfg_t *cfg = m->stall.cfg;
+    uint8_t events = MOTION_EV_STALL;
+
+    if (m->state == MOTION_GOTO || motion_calibrating(m))
+        events |= MOTION_EV_FINISHED;
+
+    model_probe_abort(&m->probe);
+    if (cfg->backoff_s > 0)
+    {
+        enter(m, MOTION_BACKOFF, cfg->backoff_s);
+        m->backoff_duty = (in->commanded_velocity >= 0) ? -cfg->backoff_duty : cfg->backoff_duty;
+    }
+    else
+        enter(m, MOTION_IDLE, 0);
+
+    return drive(MOTION_DRIVE_STOP, 0, events);
+}
+
+static motion_output_t tick_move(motion_t *m, const motion_input_t *in)
+{
+    if (!in->trusted || m->elapsed_s > m->limit_s)
+        return finish(m, MOTION_DRIVE_STOP);
+
+    int duty = position_ctrl_step(&m->ctrl, in->height, in->velocity, in->dt);
+
+    if (position_ctrl_done(&m->ctrl))
+        return finish(m, MOTION_DRIVE_STOP);
+
+    if (stalled(m, in))
+        return on_stall(m, in);
+
+    // Only the limit in the direction being driven matters
+    if ((duty > 0 && in->at_top) || (duty < 0 && in->at_bottom))
+        return finish(m, MOTION_DRIVE_STOP);
+
+    return drive(MOTION_DRIVE_DUTY, duty, 0);
+}
+
+// Calibration seek at full duty: cut early by the coast distance so the
+// column runs out just short of the stored endpoint
+static motion_output_t tick_seek(motion_t *m, const motion_input_t *in)
+{
+    if (m->cal_up ? in->at_top : in->at_bottom)
+        return cal_captured(m, in);
+
+    // Without the sensor the seek cannot be stopped on time, creep the rest
+    if (!in->trusted || m->elapsed_s > m->limit_s)
+    {
+        model_probe_abort(&m->probe);
+        return cal_sweep(m, in);
+    }
+
+    float to_go = m->cal_up ? m->seek_target - in->height : in->height - m->seek_target;
+
+    if (to_go <= motion_model_coast(m->model, m->cal_up))
+    {
+        model_probe_cut(&m->probe, m->model, in->height, true);
+        enter(m, MOTION_CAL_COAST, MODEL_COAST_S);
+        return drive(MOTION_DRIVE_STOP, 0, 0);
+    }
+
+    if (stalled(m, in))
+    {
+        model_probe_abort(&m->probe);
+        return on_stall(m, in);
+    }
+    return HOLD;
+}
+
+motion_output_t motion_tick(motion_t *m, const motion_input_t *in)
+{
+    if (m->state == MOTION_IDLE)
+        return HOLD;
+
+    m->elapsed_s += in->dt;
+
+    // The capture's run-out past the switch follows the speed it tripped at
+    if (motion_calibrating(m) && !(m->cal_up ? in->at_top : in->at_bottom))
+        m->cal_speed = fabsf(in->velocity);
+
+    if (in->locked)
+        return finish(m, MOTION_DRIVE_STOP);
+
+    if (model_probe_busy(&m->probe))
+    {
+        // A capped run says nothing about the full-duty model
+        if (in->trusted && !in->derated)
+            model_probe_tick(&m->probe, m->model, in->height, in->dt);
+        else
+            model_probe_abort(&m->probe);
+    }
+
+    switch (m->state)
+    {
+    case MOTION_JOG_UP:
+    case MOTION_JOG_DOWN:
+        if (m->state == MOTION_JOG_UP ? in->at_top : in->at_bottom)
+            return finish(m, MOTION_DRIVE_STOP);
+        if (stalled(m, in))
+            return on_stall(m, in);
+        return HOLD;
+
+    case MOTION_BACKOFF:
+        if (!m->started)
+        {
+            m->started = true;
+            return drive(MOTION_DRIVE_DUTY, m->backoff_duty, 0);
+        }
+        if ((m->backoff_duty > 0 && in->at_top) || (m->backoff_duty < 0 && in->at_bottom))
+            return finish(m, MOTION_DRIVE_STOP);
+        if (m->elapsed_s > m->limit_s)
+            return finish(m, MOTION_DRIVE_SOFT_STOP);
+        return HOLD;
+
+    case MOTION_GOTO:
+    case MOTION_CAL_CENTER:
+        return tick_move(m, in);
+
+    case MOTION_CAL_SEEK:
+        // The previous endpoint capture ran between the two ticks
+        if (!m->started)
+            return cal_head(m, in);
+        return tick_seek(m, in);
+
+    case MOTION_CAL_COAST:
+        if (m->cal_up ? in->at_top : in->at_bottom)
+            return cal_captured(m, in);
+        if (m->elapsed_s < m->limit_s)
+            return HOLD;
+        return cal_sweep(m, in);
+
+    case MOTION_CAL_SWEEP:
+        if (m->elapsed_s > m->limit_s)
+            return finish(m, MOTION_DRIVE_STOP);
+        if (!(m->cal_up ? in->at_top : in->at_bottom))
+            return stalled(m, in) ? on_stall(m, in) : HOLD;
+        return cal_captured(m, in);
+
+    default:
+        return HOLD;
+    }
+}
+
+// Seconds until a closed-loop move settles on its target, -1 when none runs
+float motion_eta(const motion_t *m)
+{
+    if (m->state != MOTION_GOTO && m->state != MOTION_CAL_CENTER)
+        return -1;
+
+    // The column trails the reference by the start-up delay at first
+    float lag = m->model->start_s - m->elapsed_s;
+    return position_ctrl_remaining_s(&m->ctrl) + (lag > 0 ? lag : 0);
+}
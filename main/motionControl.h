@@ -0,0 +1,104 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+#include "positionControl.h"
+#include "stallDetect.h"
+#include "motionModel.h"
+
+// Tick-driven motion state machine behind motor_task. Requests act the
+// moment they arrive and ticks run every control period; neither blocks, so
+// a STOP or a new target always takes over within one period. Free of
+// ESP-IDF calls: motor_task turns the outputs into motor_* calls.
+
+#define MOTION_TICK_MS 10
+#define MOTION_SWEEP_TIMEOUT_S 60.0f // calibration sweep that never finds its switch
+#define MOTION_CAL_APPROACH 0.4f     // seek stops this far short of a stored endpoint
+#define MOTION_CAL_APPROACH_DUTY 450 // slow final approach onto the switch
+#define MOTION_CAL_AGREE 0.1f        // first switch read this close to its stored endpoint: the other is kept
+#define MOTION_MOVE_MARGIN_S 3.0f    // closed-loop move allowance past its planned time
+
+typedef enum {
+    MOTION_IDLE,
+    MOTION_JOG_UP,         // HMI hold-to-move, released by motor_task's jog watchdog
+    MOTION_JOG_DOWN,
+    MOTION_GOTO,           // closed-loop move to a preset
+    MOTION_BACKOFF,        // reversing away from an obstruction after a stall
+    MOTION_CAL_SEEK,       // calibration: full duty to just short of a stored endpoint
+    MOTION_CAL_COAST,      // cut early by the coast distance, running out
+    MOTION_CAL_SWEEP,      // onto the switch, slow after a seek, full duty without limits
+    MOTION_CAL_WAIT_CENTER, // endpoints being captured, waiting for motion_cal_center()
+    MOTION_CAL_CENTER      // closed-loop move to mid stroke
+} motion_state_t;
+
+typedef enum {
+    MOTION_REQ_JOG_UP,
+    MOTION_REQ_JOG_DOWN,
+    MOTION_REQ_STOP,
+    MOTION_REQ_GOTO,
+    MOTION_REQ_CALIBRATE
+} motion_req_t;
+
+typedef enum {
+    MOTION_DRIVE_HOLD,      // leave the output as it is
+    MOTION_DRIVE_UP,        // soft-start jog drive
+    MOTION_DRIVE_DOWN,
+    MOTION_DRIVE_DUTY,      // closed-loop, signed duty
+    MOTION_DRIVE_SOFT_STOP,
+    MOTION_DRIVE_STOP       // immediate cut
+} motion_drive_t;
+
+// One-shot events for motor_task
+#define MOTION_EV_REFUSED    0x01 // request not accepted, beep
+#define MOTION_EV_CAL_BOTTOM 0x02 // parked on the bottom switch, capture it
+#define MOTION_EV_CAL_TOP    0x04 // parked on the top switch, capture it; after the
+                                  // second capture call motion_cal_center()
+#define MOTION_EV_FINISHED   0x08 // move or calibration over, back to the home page
+#define MOTION_EV_STALL      0x10 // no progress for the duty driven, motor stopped
+
+typedef struct {
+    float height;       // sensor snapshot
+    float velocity;
+    float commanded_velocity; // what the duty being driven should produce, + is up
+    bool trusted;       // height fresh and confident enough to steer by
+    bool at_top;        // hit_top_limit()
+    bool at_bottom;     // hit_bottom_limit()
+    bool locked;        // pack too empty or too hot to move
+    bool derated;       // duty capped below full by the power envelope
+    float limit_bottom; // stored endpoints, -1 when never calibrated
+    float limit_top;
+    float dt;           // seconds since the previous tick
+} motion_input_t;
+
+typedef struct {
+    motion_drive_t drive;
+    int duty;
+    uint8_t events;
+} motion_output_t;
+
+typedef struct {
+    motion_state_t state;
+    const position_cfg_t *cfg;
+    position_ctrl_t ctrl;
+    stall_detector_t stall;
+    int backoff_duty;   // signed duty of the back-off move
+    float elapsed_s;    // time in the current state
+    float limit_s;      // give up when elapsed_s passes this
+    bool started;       // the sweep of the current state is under way
+    bool cal_fast;      // calibrating from stored endpoints
+    bool cal_up;        // endpoint being captured is the top one
+    uint8_t cal_left;   // endpoints still to capture
+    float cal_bottom;   // stored endpoints the seeks aim short of
+    float cal_top;
+    float seek_target;
+    float cal_speed;    // column speed on the last tick before the switch, for the capture
+    motion_model_t *model; // measured on the calibration runs
+    model_probe_t probe;
+} motion_t;
+
+void motion_init(motion_t *m, const position_cfg_t *cfg, const stall_cfg_t *stall, motion_model_t *model);
+motion_output_t motion_request(motion_t *m, motion_req_t req, float target, const motion_input_t *in);
+motion_output_t motion_tick(motion_t *m, const motion_input_t *in);
+motion_output_t motion_cal_center(motion_t *m, float center, const motion_input_t *in);
+bool motion_busy(const motion_t *m);
+bool motion_calibrating(const motion_t *m);
+float motion_eta(const motion_t *m);
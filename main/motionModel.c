@@ -0,0 +1,127 @@
+#include "motionModel.h"
+#include <math.h>
+
+bool motion_model_valid(const motion_model_t *mm)
+{
+    return mm->version == MOTION_MODEL_VERSION &&
+           mm->speed[0] > 0.1f && mm->speed[1] > 0.1f &&
+           mm->coast[0] >= 0 && mm->coast[1] >= 0 && mm->start_s >= 0;
+}
+
+float motion_model_speed(const motion_model_t *mm, bool up)
+{
+    return mm->speed[up ? MOTION_MODEL_UP : MOTION_MODEL_DOWN];
+}
+
+float motion_model_coast(const motion_model_t *mm, bool up)
+{
+    return mm->coast[up ? MOTION_MODEL_UP : MOTION_MODEL_DOWN];
+}
+
+// Run-out after a cut at `speed`: a first-order drive coasts in proportion
+// to the speed it was cut at
+float motion_model_coast_at(const motion_model_t *mm, bool up, float speed)
+{
+    float share = fabsf(speed) / motion_model_speed(mm, up);
+
+    return motion_model_coast(mm, up) * (share < 1.0f ? share : 1.0f);
+}
+
+// First sample replaces the default, later ones are blended in
+static void fold(motion_model_t *mm, model_probe_t *p, float *field, uint8_t bit, float sample)
+{
+    *field = (mm->seen & bit) ? *field + (sample - *field) * MODEL_BLEND : sample;
+    mm->seen |= bit;
+    p->updated = true;
+}
+
+// Drive just started at full duty from standstill
+void model_probe_start(model_probe_t *p, bool up, float height)
+{
+    p->phase = MODEL_PROBE_STARTING;
+    p->dir = up ? MOTION_MODEL_UP : MOTION_MODEL_DOWN;
+    p->elapsed_s = 0;
+    p->start_height = height;
+    p->run_s = -1;
+}
+
+// Output cut. `coast` when the cut was a free run-out, not a switch or
+// obstruction stopping the column.
+void model_probe_cut(model_probe_t *p, motion_model_t *mm, float height, bool coast)
+{
+    if (p->phase != MODEL_PROBE_RUNNING)
+    {
+        p->phase = MODEL_PROBE_IDLE;
+        return;
+    }
+
+    if (p->run_s >= MODEL_MIN_RUN_S)
+    {
+        float speed = fabsf(height - p->run_height) / p->run_s;
+        if (speed > 0.1f && speed < 2.0f)
+            fold(mm, p, &mm->speed[p->dir], MODEL_SEEN_SPEED << p->dir, speed);
+    }
+
+    // Only a cut from full speed says anything about the coast
+    if (coast && p->run_s >= 0)
+    {
+        p->phase = MODEL_PROBE_COASTING;
+        p->elapsed_s = 0;
+        p->cut_height = height;
+    }
+    else
+        p->phase = MODEL_PROBE_IDLE;
+}
+
+void model_probe_tick(model_probe_t *p, motion_model_t *mm, float height, float dt)
+{
+    p->elapsed_s += dt;
+
+    switch (p->phase)
+    {
+    case MODEL_PROBE_STARTING:
+        if (fabsf(height - p->start_height) >= MODEL_MOVE_THRESHOLD)
+        {
+            float start = p->elapsed_s - MODEL_MOVE_THRESHOLD / mm->speed[p->dir];
+            fold(mm, p, &mm->start_s, MODEL_SEEN_START, start > 0 ? start : 0);
+            p->phase = MODEL_PROBE_RUNNING;
+            p->elapsed_s = 0;
+        }
+        else if (p->elapsed_s > 3.0f)
+            p->phase = MODEL_PROBE_IDLE; // never got going, the stall detector deals with it
+        break;
+
+    case MODEL_PROBE_RUNNING:
+        if (p->run_s >= 0)
+            p->run_s += dt;
+        else if (p->elapsed_s >= MODEL_SETTLE_S)
+        {
+            p->run_height = height;
+            p->run_s = 0;
+        }
+        break;
+
+    case MODEL_PROBE_COASTING:
+        if (p->elapsed_s >= MODEL_COAST_S)
+        {
+            float coast = fabsf(height - p->cut_height);
+            if (coast < 1.0f)
+                fold(mm, p, &mm->coast[p->dir], MODEL_SEEN_COAST << p->dir, coast);
+            p->phase = MODEL_PROBE_IDLE;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void model_probe_abort(model_probe_t *p)
+{
+    p->phase = MODEL_PROBE_IDLE;
+}
+
+bool model_probe_busy(const model_probe_t *p)
+{
+    return p->phase != MODEL_PROBE_IDLE;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// How the column moves, measured on the full-duty runs of a calibration:
+// speed at full duty per direction, travel after an immediate cut, and the
+// delay between starting the drive and the column getting under way.
+// Free of ESP-IDF calls; motor_task stores the model in NVS.
+
+#define MOTION_MODEL_VERSION 1
+#define MOTION_MODEL_DOWN 0        // index of the per-direction fields
+#define MOTION_MODEL_UP 1
+
+#define MODEL_MOVE_THRESHOLD 0.05f // travel that counts as under way
+#define MODEL_SETTLE_S 0.5f        // running time ignored for speed, covers the soft start
+#define MODEL_MIN_RUN_S 1.0f       // shorter runs give no speed sample
+#define MODEL_COAST_S 0.6f         // time a cut column is watched for its coast
+#define MODEL_BLEND 0.3f           // weight of a new sample once the model has one
+
+// motion_model_t.seen, quantities measured at least once
+#define MODEL_SEEN_SPEED 0x01      // shifted left by the direction index
+#define MODEL_SEEN_COAST 0x04      // likewise
+#define MODEL_SEEN_START 0x10
+
+typedef struct {
+    uint8_t version;
+    uint8_t seen;     // MODEL_SEEN_* bits, 0 = defaults only
+    float speed[2];   // full-duty speed, [MOTION_MODEL_DOWN] / [MOTION_MODEL_UP]
+    float coast[2];   // travel after an immediate cut from full speed
+    float start_s;    // drive start to MODEL_MOVE_THRESHOLD, less that travel at speed
+} motion_model_t;
+
+// 0.65/s full duty (DIST_SPEED_UP/DOWN), tau 0.15 s
+#define MOTION_MODEL_DEFAULT {                                   \
+    .version = MOTION_MODEL_VERSION, .seen = 0,                 \
+    .speed = {0.65f, 0.65f}, .coast = {0.1f, 0.1f}, .start_s = 0.3f}
+
+typedef enum {
+    MODEL_PROBE_IDLE,
+    MODEL_PROBE_STARTING, // drive on, column not moving yet
+    MODEL_PROBE_RUNNING,
+    MODEL_PROBE_COASTING  // cut, column running out
+} model_probe_phase_t;
+
+// Watches one full-duty run and folds what it saw into the model
+typedef struct {
+    model_probe_phase_t phase;
+    int dir;              // MOTION_MODEL_UP / MOTION_MODEL_DOWN
+    float elapsed_s;      // time in the current phase
+    float start_height;
+    float run_height;     // height when the speed measurement began
+    float run_s;          // time since then
+    float cut_height;
+    bool updated;         // the model took a sample since the flag was cleared
+} model_probe_t;
+
+bool motion_model_valid(const motion_model_t *mm);
+float motion_model_speed(const motion_model_t *mm, bool up);
+float motion_model_coast(const motion_model_t *mm, bool up);
+float motion_model_coast_at(const motion_model_t *mm, bool up, float speed);
+
+void model_probe_start(model_probe_t *p, bool up, float height);
+void model_probe_cut(model_probe_t *p, motion_model_t *mm, float height, bool coast);
+void model_probe_tick(model_probe_t *p, motion_model_t *mm, float height, float dt);
+void model_probe_abort(model_probe_t *p);
+bool model_probe_busy(const model_probe_t *p);
@@ -0,0 +1,123 @@
+#include "motionTrace.h"
+#include "traceDump.h"
+#include "stdlib.h"
+#include "stdio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static motion_trace_rec_t *ring = NULL;
+static volatile uint32_t head = 0;         // records committed since boot
+static volatile bool frozen = false;       // a dump is reading the ring
+static volatile bool writing = false;      // motor_task inside a record, see freeze()
+static volatile uint32_t dropped = 0;      // ticks not recorded while frozen
+static motion_trace_cost_t cost;           // written by motor_task only
+
+bool motion_trace_init(void)
+{
+    if (ring == NULL)
+        ring = malloc(MOTION_TRACE_LEN * sizeof(motion_trace_rec_t));
+
+    if (ring == NULL)
+    {
+        printf("No memory for the motion trace\n");
+        return false;
+    }
+    return true;
+}
+
+// Slot for the next record, NULL when there is no ring or a dump holds it.
+// The writer fills it in and calls motion_trace_commit(). `writing` goes up
+// before `frozen` is checked, the same handshake as the ADC trace sampler.
+motion_trace_rec_t *motion_trace_next(void)
+{
+    if (ring == NULL)
+        return NULL;
+    __atomic_store_n(&writing, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&frozen, __ATOMIC_SEQ_CST))
+    {
+        __atomic_store_n(&writing, false, __ATOMIC_RELEASE);
+        dropped++;
+        return NULL;
+    }
+    return &ring[head & (MOTION_TRACE_LEN - 1)];
+}
+
+void motion_trace_commit(void)
+{
+    // The record is in memory before a reader can see the new head
+    __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&writing, false, __ATOMIC_RELEASE);
+}
+
+uint32_t motion_trace_dropped(void)
+{
+    return dropped;
+}
+
+void motion_trace_add_cost(uint32_t cycles)
+{
+    cost.count++;
+    cost.last = cycles;
+    if (cycles > cost.max)
+        cost.max = cycles;
+    if (cycles > MOTION_TRACE_BUDGET_CYCLES)
+        cost.over++;
+    cost.total += cycles;
+}
+
+// A copy for the PC task, a field may be one tick newer than the others
+void motion_trace_get_cost(motion_trace_cost_t *out)
+{
+    *out = cost;
+}
+
+static int ring_runs(trace_run_t runs[2])
+{
+    uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+
+    if (ring == NULL || h == 0)
+        return 0;
+
+    if (h <= MOTION_TRACE_LEN)
+    {
+        runs[0] = (trace_run_t){ring, h};
+        return 1;
+    }
+
+    uint32_t oldest = h & (MOTION_TRACE_LEN - 1);
+    runs[0] = (trace_run_t){&ring[oldest], MOTION_TRACE_LEN - oldest};
+    runs[1] = (trace_run_t){ring, oldest};
+    return oldest ? 2 : 1;
+}
+
+// Stop motor_task starting records and wait out one it is part way
+// through. Once `writing` reads low after `frozen` was set, nothing is in
+// flight and nothing new starts.
+static void freeze(void)
+{
+    __atomic_store_n(&frozen, true, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&writing, __ATOMIC_SEQ_CST))
+        vTaskDelay(1);
+}
+
+// Freeze, send, resume
+static bool dump(bool (*out)(uint8_t, uint8_t, const trace_run_t *, int))
+{
+    trace_run_t runs[2];
+    bool ok;
+
+    freeze();
+    ok = out(TRACE_TYPE_MOTION, sizeof(motion_trace_rec_t), runs, ring_runs(runs));
+    __atomic_store_n(&frozen, false, __ATOMIC_RELEASE);
+    return ok;
+}
+
+bool motion_trace_dump_uart(void)
+{
+    return dump(trace_dump_uart);
+}
+
+bool motion_trace_save(void)
+{
+    return dump(trace_save_partition);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// Always-on ring of motor_task control ticks for post-mortem analysis of a
+// move. One writer (motor_task), no locks: a record is filled in before the
+// head moves past it. A dump freezes the ring and waits out a record in
+// flight, so the writer cannot overwrite what is being sent; ticks in the
+// meantime are counted as dropped.
+
+#define MOTION_TRACE_LEN      4096  // records, power of two, 64 KB allocated at init (~40 s of motion)
+#define MOTION_TRACE_TAIL     50    // ticks still recorded after the motor stopped, for the coast
+#define MOTION_TRACE_SCALE    1000  // heights and velocities are fixed point, x1000
+#define MOTION_TRACE_NONE     INT16_MIN // no target
+#define MOTION_TRACE_NO_CMD   0xFF
+#define MOTION_TRACE_BUDGET_CYCLES 160 // one microsecond at the 160 MHz CPU clock
+
+// flags byte of a record
+#define MOTION_TRACE_DIR_MASK  0x03 // motor_direction_t, 3 = stopped
+#define MOTION_TRACE_RUNNING   0x04 // motor powered
+#define MOTION_TRACE_AT_TOP    0x08 // hit_top_limit()
+#define MOTION_TRACE_AT_BOTTOM 0x10 // hit_bottom_limit()
+#define MOTION_TRACE_TRUSTED   0x20 // dist_sensor_trusted()
+#define MOTION_TRACE_LOCKED    0x40 // low-SOC lockout
+#define MOTION_TRACE_STOPPING  0x80 // soft stop fading out
+
+typedef struct __attribute__((packed)) {
+    uint32_t timestamp_us;
+    int16_t height;       // x1000
+    int16_t target;       // x1000, MOTION_TRACE_NONE outside closed-loop moves
+    int16_t velocity;     // x1000 per second, + is up
+    int16_t duty;         // LEDC duty on the output, + drives up
+    uint8_t state;        // motion_state_t
+    uint8_t flags;
+    uint8_t events;       // MOTION_EV_* raised on this tick
+    uint8_t cmd;          // motor_cmd_t handled since the previous tick, MOTION_TRACE_NO_CMD if none
+} motion_trace_rec_t;
+
+// CPU cycles motor_task spends on a record, from esp_cpu_get_ccount()
+typedef struct {
+    uint32_t count;     // ticks measured
+    uint32_t last;
+    uint32_t max;
+    uint32_t over;      // ticks above MOTION_TRACE_BUDGET_CYCLES
+    uint64_t total;
+} motion_trace_cost_t;
+
+bool motion_trace_init(void);
+motion_trace_rec_t *motion_trace_next(void);
+void motion_trace_commit(void);
+uint32_t motion_trace_dropped(void);
+void motion_trace_add_cost(uint32_t cycles);
+void motion_trace_get_cost(motion_trace_cost_t *out);
+bool motion_trace_dump_uart(void);
+bool motion_trace_save(void);
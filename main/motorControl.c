@@ -3,12 +3,146 @@
 #include "DWIN_HMI.h"
 #include "nvsManager.h"
 #include "Daly_BMS.h"
+#include "motionControl.h"
+#include "limitLearn.h"
+#include "motionTrace.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "hal/gpio_ll.h"
+#include "stdlib.h"
 
 motor_direction_t current_dir = MOTOR_DIR_FORWARD;
-bool calibrating = false;
+volatile bool calibrating = false;
 int8_t initial_calib = 0;
-bool motorRunning = 0;
-static uint32_t last_cmd_time = 0;
+volatile bool motorRunning = 0;
+static volatile bool ramping = false;   // ramp in progress, motor_task steps it every tick
+static volatile bool stopping = false;  // soft stop fading out, driver sleeps when it ends
+static volatile bool reversing = false; // fading out to reverse, motor_task flips the bridge when it ends
+static motor_direction_t reverse_dir;   // direction the reversal ends in
+static int ramp_from, ramp_to, ramp_ms; // duty span and length of the ramp
+static int64_t ramp_start_us;
+static TaskHandle_t motorTaskHandle = NULL;
+static esp_timer_handle_t jog_watchdog = NULL;
+static volatile bool watchdog_fired = false; // jog cut by the watchdog, motion not told yet
+static volatile limit_stats_t limit_stats;
+static const position_cfg_t position_base = POSITION_CFG_DEFAULT;
+static position_cfg_t position_cfg = POSITION_CFG_DEFAULT; // follows motion_model and the power envelope
+static float power_share = 1.0f;        // envelope share the drive is limited to
+static const stall_cfg_t stall_cfg = STALL_CFG_DEFAULT;
+static motion_model_t motion_model = MOTION_MODEL_DEFAULT;
+static int eta_shown = -1;              // seconds on the ETA display, -1 = none yet
+static const limit_learn_cfg_t learn_cfg = LIMIT_LEARN_CFG_DEFAULT;
+static limit_learner_t learn_bottom, learn_top;
+static volatile int8_t limit_hit_pin = -1; // switch the ISR last cut on, -1 = none
+static gpio_num_t learn_pin;
+static TickType_t learn_tick = 0;       // read the parked height then, 0 = nothing pending
+static float learn_speed = 0;           // column speed when the switch cut it
+static uint8_t trace_cmd = MOTION_TRACE_NO_CMD; // command handled since the last traced tick
+static int trace_tail = 0;              // ticks still traced after the motor stopped
+static motion_t motion;                 // driven by motor_task, or run_calibration() at first boot
+static float cal_bottom_mm = 0;         // endpoints of the calibration in progress, as stored until captured
+static float cal_top_mm = 0;
+static float anchor_speed[2];           // [bottom, top] speed each endpoint was captured at, NVS "limit_anchor"
+static portMUX_TYPE limit_shift_mux = portMUX_INITIALIZER_UNLOCKED;
+static float limit_shift[2];            // [bottom, top] corrections not yet applied by motor_task
+static TickType_t page_restore_tick = 0; // home page after the preset-saved page, 0 = none
+
+// Runs in the GPIO ISR or the watchdog callback: sleep the driver, which
+// drops the bridge without waiting for motor_task. In IRAM and on the GPIO
+// registers, so a cut still happens while an NVS write has the flash cache
+// off. motor_task is notified and stops the PWM in motor_stop().
+static void IRAM_ATTR motor_cut(void)
+{
+    gpio_ll_set_level(&GPIO, SLP_PIN, MOTOR_SLEEP);
+    motorRunning = 0;
+}
+
+static void IRAM_ATTR limit_isr(void *arg)
+{
+    int64_t t0 = esp_timer_get_time();
+    gpio_num_t pin = (gpio_num_t)(intptr_t)arg;
+
+    // Only cut when driving into this switch, leaving it is always allowed
+    if (!motorRunning)
+        return;
+    if (pin == PROXIMITY_TOP && current_dir != MOTOR_DIR_FORWARD)
+        return;
+    if (pin == PROXIMITY_BOTTOM && current_dir != MOTOR_DIR_BACKWARD)
+        return;
+
+    // Glitch filter: a real hit holds the level for LIMIT_CONFIRM_US, the
+    // spikes the motor induces on the line are gone well before that
+    while (esp_timer_get_time() - t0 < LIMIT_CONFIRM_US)
+    {
+        if (!gpio_ll_get_level(&GPIO, pin))
+        {
+            limit_stats.glitches++;
+            return;
+        }
+    }
+
+    motor_cut();
+    limit_hit_pin = pin;
+
+    uint32_t latency = (uint32_t)(esp_timer_get_time() - t0);
+    limit_stats.count++;
+    limit_stats.last_us = latency;
+    if (latency > limit_stats.max_us)
+        limit_stats.max_us = latency;
+
+    if (motorTaskHandle)
+    {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(motorTaskHandle, &woken);
+        if (woken)
+            portYIELD_FROM_ISR();
+    }
+}
+
+void motor_get_limit_stats(limit_stats_t *out)
+{
+    out->count = limit_stats.count;
+    out->glitches = limit_stats.glitches;
+    out->last_us = limit_stats.last_us;
+    out->max_us = limit_stats.max_us;
+    out->watchdog = limit_stats.watchdog;
+}
+
+// esp_timer task: no jog repeat came in time, the button release was lost
+static void jog_watchdog_cb(void *arg)
+{
+    if (!motorRunning)
+        return;
+
+    motor_cut();
+    limit_stats.watchdog++;
+    watchdog_fired = true;
+    if (motorTaskHandle)
+        xTaskNotifyGive(motorTaskHandle);
+}
+
+static const uint16_t watchdog_ms[] = {
+    [MOTOR_CMD_FORWARD] = MOTOR_WDT_JOG_UP_MS,
+    [MOTOR_CMD_BACKWARD] = MOTOR_WDT_JOG_DOWN_MS,
+};
+
+// Re-arm for a guarded command, disarm for anything else
+static void jog_watchdog_kick(motor_cmd_t cmd)
+{
+    uint16_t ms = (cmd < sizeof(watchdog_ms) / sizeof(watchdog_ms[0])) ? watchdog_ms[cmd] : 0;
+
+    esp_timer_stop(jog_watchdog);
+    if (ms)
+        esp_timer_start_once(jog_watchdog, ms * 1000ULL);
+}
+
+static void limit_isr_init(void)
+{
+    gpio_install_isr_service(ESP_INTR_FLAG_IRAM); // runs during flash writes too
+    gpio_isr_handler_add(PROXIMITY_TOP, limit_isr, (void *)PROXIMITY_TOP);
+    gpio_isr_handler_add(PROXIMITY_BOTTOM, limit_isr, (void *)PROXIMITY_BOTTOM);
+}
 
 void motorInit()
 {
@@ -31,7 +165,20 @@ void motorInit()
         .hpoint = 0};
     ledc_channel_config(&ledc_channel);
 
+    // ledc_set_duty_and_update() needs the fade service; ramps themselves
+    // are stepped by motor_task, so a stop never has to cancel a fade
+    ledc_fade_func_install(0);
+
     motor_stop();
+    motion_init(&motion, &position_cfg, &stall_cfg, &motion_model);
+
+    limit_isr_init(); // Proximity switches cut the PWM straight from their ISR
+    motion_trace_init();
+
+    esp_timer_create_args_t wdt_args = {
+        .callback = jog_watchdog_cb,
+        .name = "jog_wdt"};
+    esp_timer_create(&wdt_args, &jog_watchdog);
 }
 
 void motor_set_direction(motor_direction_t dir)
@@ -51,284 +198,723 @@ void motor_set_speed(int duty)
     if (duty > 1023)
         duty = 1023;
 
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, duty);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    ramping = false; // a ramp still running is taken over, not finished
+    ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, duty, 0);
 }
 
-void motor_forward()
+// Duty on the output right now, follows a ramp while it runs
+int motor_get_duty(void)
 {
-    motorRunning = 1;
-    current_dir = MOTOR_DIR_FORWARD;
-    motorSleepContrl(MOTOR_WAKE);
-    motor_set_direction(MOTOR_DIR_FORWARD);
-    motor_set_speed(1023);
+    return motorRunning ? (int)ledc_get_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0) : 0;
 }
 
-void motor_backward()
+// Velocity the column is being driven at, + is up. Control input of the
+// height estimator and the stall detector.
+float motor_commanded_velocity(void)
+{
+    if (!motorRunning)
+        return 0;
+
+    float duty = motor_get_duty() / 1023.0f;
+
+    if (current_dir == MOTOR_DIR_FORWARD)
+        return duty * motion_model_speed(&motion_model, true);
+    if (current_dir == MOTOR_DIR_BACKWARD)
+        return -duty * motion_model_speed(&motion_model, false);
+    return 0;
+}
+
+// Duty ceiling of the power envelope
+static int max_duty(void)
+{
+    return (int)(MOTOR_CRUISE_DUTY * power_share);
+}
+
+// Closed-loop cruise and feed-forward follow the measured full-duty speeds,
+// cruise and acceleration shrink with the power envelope
+static void apply_model(void)
+{
+    const position_dir_cfg_t *base[2] = {&position_base.down, &position_base.up};
+    position_dir_cfg_t *dirs[2] = {&position_cfg.down, &position_cfg.up};
+
+    for (int i = 0; i < 2; i++)
+    {
+        float speed = motion_model.speed[i];
+        dirs[i]->v_max = speed * MOTOR_CRUISE_SHARE * power_share;
+        dirs[i]->accel = base[i]->accel * power_share;
+        dirs[i]->kff = MOTOR_CRUISE_DUTY / speed;
+    }
+}
+
+// The BMS task moved the envelope: re-plan closed-loop moves and pull a
+// jog already cruising down to the new ceiling
+static void follow_power_envelope(void)
 {
+    if (powerEnvelope.share == power_share)
+        return;
+
+    power_share = powerEnvelope.share;
+    apply_model();
+    if (motorRunning && !stopping && !ramping && motor_get_duty() > max_duty())
+        motor_set_speed(max_duty());
+}
+
+void motor_load_model(void)
+{
+    if (!load_blob("motion_model", &motion_model, sizeof(motion_model)) || !motion_model_valid(&motion_model))
+    {
+        motion_model_t defaults = MOTION_MODEL_DEFAULT;
+        motion_model = defaults;
+    }
+    apply_model();
+}
+
+static void store_model(void)
+{
+    // printf("Motion model: up %.3f/s coast %.3f, down %.3f/s coast %.3f, start %.2f s\n",
+    //        motion_model.speed[MOTION_MODEL_UP], motion_model.coast[MOTION_MODEL_UP],
+    //        motion_model.speed[MOTION_MODEL_DOWN], motion_model.coast[MOTION_MODEL_DOWN], motion_model.start_s);
+    save_blob("motion_model", &motion_model, sizeof(motion_model));
+    apply_model();
+}
+
+// Never waits: a ramp still running is taken over from its current duty.
+// motor_task steps it (motor_ramp_tick()), one duty write per tick.
+static void motor_ramp(int duty, int ms)
+{
+    ramp_from = ledc_get_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    ramp_to = duty;
+    ramp_ms = ms;
+    ramp_start_us = esp_timer_get_time();
+    ramping = true;
+}
+
+static void motor_run(motor_direction_t dir)
+{
+    stopping = false;
+    reversing = false;
     motorRunning = 1;
-    current_dir = MOTOR_DIR_BACKWARD;
+    current_dir = dir;
+    dist_set_profile(DIST_PROFILE_MOVING);
     motorSleepContrl(MOTOR_WAKE);
-    motor_set_direction(MOTOR_DIR_BACKWARD);
-    motor_set_speed(1023);
+    motor_set_direction(dir);
+    motor_ramp(max_duty(), MOTOR_RAMP_UP_MS);
 }
 
-void motor_stop(void)
+// Soft start to cruise duty, capped by the power envelope. The ramp time
+// stays, so a lower cap ramps more gently too. Repeated jog commands in the
+// running direction leave the ramp alone; a jog taking over a closed-loop
+// move in the same direction ramps on from the duty the controller left.
+// A reversal fades out in the old direction first, motor_task keeps
+// ticking and flips the bridge when the ramp ends (motor_reverse()).
+static void motor_start(motor_direction_t dir)
 {
-    motorRunning = 0;
-    current_dir = 3;
-    motor_set_speed(0);
-    motorSleepContrl(MOTOR_SLEEP);
+    if (reversing && dir == reverse_dir)
+        return;
+    if (motorRunning && current_dir == dir && !stopping && !reversing)
+    {
+        if (!ramping && motor_get_duty() < max_duty())
+            motor_ramp(max_duty(), MOTOR_RAMP_UP_MS);
+        return;
+    }
+
+    if (motorRunning && current_dir != dir)
+    {
+        // A soft stop already fading out just becomes the reversal
+        reverse_dir = dir;
+        reversing = true;
+        if (!stopping)
+            motor_ramp(0, MOTOR_RAMP_DOWN_MS);
+        stopping = false;
+        return;
+    }
+    motor_run(dir);
+}
+
+// The fade-out of a reversal ended
+static void motor_reverse(void)
+{
+    motor_run(reverse_dir);
 }
 
-void movetoCenter()
+// motor_task, every tick: the next duty of a running ramp. At its end a
+// soft stop puts the driver to sleep and a reversal flips the bridge.
+static void motor_ramp_tick(void)
 {
-    int64_t now = esp_timer_get_time();
-    motor_backward();
-    while (esp_timer_get_time() - now < 13000000)
+    if (!ramping)
+        return;
+    if (!motorRunning) // cut by a limit, the watchdog or the BMS meanwhile
     {
-        vTaskDelay(pdMS_TO_TICKS(10));
+        ramping = false;
+        return;
     }
-    motor_stop();
+
+    int64_t elapsed_ms = (esp_timer_get_time() - ramp_start_us) / 1000;
+    bool done = elapsed_ms >= ramp_ms;
+    int duty = done ? ramp_to : ramp_from + (int)((ramp_to - ramp_from) * elapsed_ms / ramp_ms);
+
+    ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, duty, 0);
+    if (!done)
+        return;
+    ramping = false;
+    if (reversing)
+        motor_reverse();
+    else if (stopping)
+        motor_stop();
 }
 
-void move_to_position(float target)
+void motor_forward()
 {
-    // printf("Target = %f, Current Height = %f\r\n", target, current_height_mm);
+    motor_start(MOTOR_DIR_FORWARD);
+}
 
-    bool going_up = (target > current_height_mm);
+void motor_backward()
+{
+    motor_start(MOTOR_DIR_BACKWARD);
+}
 
-    if (going_up)
-        motor_forward();
-    else
-        motor_backward();
+// Closed-loop drive: signed duty, + is up. Direction changes on the fly.
+static void motor_drive(int duty)
+{
+    motor_direction_t dir = (duty >= 0) ? MOTOR_DIR_FORWARD : MOTOR_DIR_BACKWARD;
+    int magnitude = abs(duty);
 
-    while (1)
+    if (!motorRunning || current_dir != dir || stopping || reversing)
     {
-        // If going UP, only top limit matters
-        if (going_up && hit_top_limit())
-        {
-            motor_stop();
-            // printf("Stopped: Top limit hit\n");
-            break;
-        }
+        stopping = false;
+        reversing = false;
+        motorRunning = 1;
+        current_dir = dir;
+        dist_set_profile(DIST_PROFILE_MOVING);
+        motorSleepContrl(MOTOR_WAKE);
+        motor_set_direction(dir);
+    }
+    motor_set_speed(magnitude < max_duty() ? magnitude : max_duty());
+}
 
-        // If going DOWN, only bottom limit matters
-        if (!going_up && hit_bottom_limit())
-        {
-            motor_stop();
-            // printf("Stopped: Bottom limit hit\n");
-            break;
-        }
+// Immediate cut for limits, faults and emergencies: does not wait for a ramp
+void motor_stop(void)
+{
+    stopping = false;
+    reversing = false;
+    ramping = false;
+    motorSleepContrl(MOTOR_SLEEP);
+    ledc_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 0);
+    motorRunning = 0;
+    current_dir = 3;
+    dist_set_profile(DIST_PROFILE_IDLE);
+}
 
-        // Normal position comparison
-        if (fabs(current_height_mm - target) < 0.1f)
-        {
-            // printf("Reached height: %f\n", current_height_mm);
-            motor_stop();
-            break;
-        }
+// Ramped stop for normal operation. The column keeps its direction and the
+// limits stay armed until the ramp ends and motor_task calls motor_stop().
+void motor_soft_stop(void)
+{
+    if (!motorRunning || stopping)
+        return;
 
-        vTaskDelay(pdMS_TO_TICKS(10));
+    // Still on the way up, or fading out for a reversal: the duty is low
+    if (ramping || reversing)
+    {
+        motor_stop();
+        return;
     }
+
+    stopping = true;
+    motor_ramp(0, MOTOR_RAMP_DOWN_MS);
 }
 
-void run_calibration()
+// Home page for the current theme and PC link state
+static void show_home_page(void)
 {
-    calibrating = true;
     int8_t theme = loadTheme();
+    int page;
+
+    if (pcConnected)
+        page = (theme == 1) ? 5 : 1;
+    else
+        page = (theme == 1) ? 21 : 18;
+
     if (!initial_calib)
+        display_set_page(page);
+    else
+        setPage(page);
+}
+
+static void read_motion_input(motion_input_t *in, float dt)
+{
+    height_state_t s;
+
+    dist_get_state(&s);
+    in->height = s.height_mm;
+    in->velocity = s.velocity_mm_s;
+    in->commanded_velocity = motor_commanded_velocity();
+    in->trusted = dist_sensor_trusted();
+    in->at_top = hit_top_limit();
+    in->at_bottom = hit_bottom_limit();
+    in->locked = motorLockedLowSOC;
+    in->derated = power_share < 1.0f;
+    dist_get_limits(&in->limit_bottom, &in->limit_top);
+    in->dt = dt;
+}
+
+// Capture one calibration endpoint, the motor is stopped while this runs.
+// The speed it came onto the switch at goes with it: a slow approach in a
+// calibration from stored endpoints, full duty in a sweep.
+static float capture_endpoint(uint8_t which, const char *key)
+{
+    float height = dist_cal_capture_endpoint(which);
+    save_limit(key, height);
+    anchor_speed[which == IR_CAL_TOP] = motion.cal_speed;
+    save_blob("limit_anchor", anchor_speed, sizeof(anchor_speed));
+    return height;
+}
+
+// Endpoints stored before the capture speed was kept were all slow approaches
+static void load_anchor_speeds(void)
+{
+    if (load_blob("limit_anchor", anchor_speed, sizeof(anchor_speed)))
+        return;
+    for (int top = 0; top < 2; top++)
+        anchor_speed[top] = MOTION_CAL_APPROACH_DUTY / (float)MOTOR_CRUISE_DUTY * motion_model_speed(&motion_model, top);
+}
+
+static void apply_motion(const motion_output_t *out)
+{
+    switch (out->drive)
     {
-        display_set_page(theme == 1 ? 15 : 14);
+    case MOTION_DRIVE_UP:
+        motor_forward();
+        break;
+    case MOTION_DRIVE_DOWN:
+        motor_backward();
+        break;
+    case MOTION_DRIVE_DUTY:
+        motor_drive(out->duty);
+        break;
+    case MOTION_DRIVE_SOFT_STOP:
+        motor_soft_stop();
+        break;
+    case MOTION_DRIVE_STOP:
+        motor_stop();
+        break;
+    default:
+        break;
     }
-    else
+
+    if (out->events & MOTION_EV_REFUSED)
+        display_beep();
+
+    if (out->events & MOTION_EV_STALL)
     {
-        setPage(theme == 1 ? 15 : 14);
+        // printf("Stall at %.2f\n", dist_height());
+        if (pcConnected)
+            uart_write_bytes(PC_UART, "stall\r\n", 7);
+        display_beep();
     }
-    // Move down
-    motor_backward();
-    while (!hit_bottom_limit())
+
+    // Learning restarts from a captured endpoint; one the calibration
+    // skipped keeps its learner
+    if (out->events & MOTION_EV_CAL_BOTTOM)
     {
-        vTaskDelay(pdMS_TO_TICKS(10));
+        cal_bottom_mm = capture_endpoint(IR_CAL_BOTTOM, "limit_bottom");
+        limit_learn_init(&learn_bottom, &learn_cfg, cal_bottom_mm);
     }
-    vTaskDelay(pdMS_TO_TICKS(10));
-    // printf("Reached Down\r\n");
-    motor_stop();
-    vTaskDelay(pdMS_TO_TICKS(10));
-    if (initial_calib)
+
+    if (out->events & MOTION_EV_CAL_TOP)
     {
-        read_distance_mm();
+        cal_top_mm = capture_endpoint(IR_CAL_TOP, "limit_top");
+        limit_learn_init(&learn_top, &learn_cfg, cal_top_mm);
     }
-    bottom_limit_mm = current_height_mm;
-    // printf("Bottom = %f\r\n", bottom_limit_mm);
-    save_limit("limit_bottom", bottom_limit_mm);
 
-    // Move up
-    motor_forward();
-    while (!hit_top_limit())
+    // Both endpoints captured, finish with a closed-loop move to mid stroke
+    if (motion.state == MOTION_CAL_WAIT_CENTER)
     {
-        vTaskDelay(pdMS_TO_TICKS(10));
+        motion_input_t in;
+        motion_output_t next;
+
+        dist_set_limits(cal_bottom_mm, cal_top_mm);
+        read_motion_input(&in, 0);
+        next = motion_cal_center(&motion, (cal_bottom_mm + cal_top_mm) / 2, &in);
+        apply_motion(&next);
     }
-    vTaskDelay(pdMS_TO_TICKS(10));
-    // printf("Reached Up\r\n");
-    motor_stop();
 
-    vTaskDelay(pdMS_TO_TICKS(10));
-    if (initial_calib)
+    if (out->events & MOTION_EV_FINISHED)
     {
-        for (int8_t i = 0; i < 10; i++)
+        if (motion.probe.updated)
         {
-            read_distance_mm();
+            motion.probe.updated = false;
+            store_model();
         }
+        calibrating = false;
+        show_home_page();
     }
-    top_limit_mm = current_height_mm;
-    // printf("Top = %f", top_limit_mm);
-    save_limit("limit_top", top_limit_mm);
+}
 
-    float center = (top_limit_mm + bottom_limit_mm) / 2;
-    if (initial_calib)
-    {
-        movetoCenter();
-    }
+static void start_calibration_page(void)
+{
+    int8_t theme = loadTheme();
+
+    calibrating = true;
+    if (!initial_calib)
+        display_set_page(theme == 1 ? 15 : 14);
     else
+        setPage(theme == 1 ? 15 : 14);
+}
+
+// Blocking calibration for first boot, before motor_task runs. The sampler
+// is already up, so the centre move is closed-loop like any other.
+void run_calibration()
+{
+    motion_input_t in;
+    motion_output_t out;
+    int64_t last = esp_timer_get_time();
+
+    start_calibration_page();
+    read_motion_input(&in, 0);
+    cal_bottom_mm = in.limit_bottom; // kept when the calibration skips an end
+    cal_top_mm = in.limit_top;
+    out = motion_request(&motion, MOTION_REQ_CALIBRATE, 0, &in);
+    apply_motion(&out);
+
+    while (motion_busy(&motion))
     {
-        move_to_position(center);
+        vTaskDelay(pdMS_TO_TICKS(MOTION_TICK_MS));
+        motor_ramp_tick();
+
+        int64_t now = esp_timer_get_time();
+        read_motion_input(&in, (now - last) / 1000000.0f);
+        last = now;
+        out = motion_tick(&motion, &in);
+        apply_motion(&out);
     }
-    if (pcConnected)
+    calibrating = false;
+}
+
+static void handle_command(motor_cmd_t cmd)
+{
+    motion_input_t in;
+    motion_output_t out;
+    int8_t theme;
+
+    read_motion_input(&in, 0);
+    trace_cmd = cmd;
+    if (cmd != MOTOR_CMD_FORWARD && cmd != MOTOR_CMD_BACKWARD && cmd != MOTOR_CMD_SAVE_POSITION)
+        jog_watchdog_kick(cmd);
+
+    switch (cmd)
     {
-        if (!initial_calib)
+    // Only a jog the state machine took is guarded: a refused one (during
+    // calibration) must not leave a timer that cuts the motor under it
+    case MOTOR_CMD_FORWARD:
+        out = motion_request(&motion, MOTION_REQ_JOG_UP, 0, &in);
+        jog_watchdog_kick(out.drive == MOTION_DRIVE_UP ? cmd : MOTOR_CMD_STOP);
+        break;
+    case MOTOR_CMD_BACKWARD:
+        out = motion_request(&motion, MOTION_REQ_JOG_DOWN, 0, &in);
+        jog_watchdog_kick(out.drive == MOTION_DRIVE_DOWN ? cmd : MOTOR_CMD_STOP);
+        break;
+    case MOTOR_CMD_STOP:
+        out = motion_request(&motion, MOTION_REQ_STOP, 0, &in);
+        break;
+
+    case MOTOR_CMD_GOTO_POSITION:
+        // Refuses to drive to a height the sensor cannot confirm
+        out = motion_request(&motion, MOTION_REQ_GOTO, target_position_mm, &in);
+        if (!(out.events & MOTION_EV_REFUSED))
         {
-            display_set_page(theme == 1 ? 5 : 1);
+            page_restore_tick = 0;
+            eta_shown = -1;
+            theme = loadTheme();
+            display_set_page(theme == 1 ? 16 : 17);
         }
-        else
+        break;
+
+    case MOTOR_CMD_CALIBRATE:
+        // Endpoints captured from a faulty sensor would corrupt the limits
+        if (!dist_sensor_trusted() || motion_calibrating(&motion))
         {
-            setPage(theme == 1 ? 5 : 1);
+            display_beep();
+            return;
         }
-    }
-    else
-    {
-        if (!initial_calib)
+        cal_bottom_mm = in.limit_bottom; // kept when the calibration skips an end
+        cal_top_mm = in.limit_top;
+        out = motion_request(&motion, MOTION_REQ_CALIBRATE, 0, &in);
+        if (!(out.events & MOTION_EV_REFUSED))
         {
-            display_set_page(theme == 1 ? 21 : 18);
+            page_restore_tick = 0;
+            start_calibration_page();
         }
-        else
+        break;
+
+    case MOTOR_CMD_SAVE_POSITION:
+        if (dist_sensor_trusted())
         {
-            setPage(theme == 1 ? 21 : 18);
+            savePreset(selected_preset, dist_height());
         }
+        // printf("Saving Presets\r\n");
+        theme = loadTheme();
+        display_set_page(theme == 1 ? 8 : 4);
+        display_beep();
+        // Back to the home page after a second, motion carries on meanwhile
+        page_restore_tick = xTaskGetTickCount() + pdMS_TO_TICKS(1000);
+        if (page_restore_tick == 0)
+            page_restore_tick = 1;
+        return;
+
+    default:
+        return;
     }
-    calibrating = false;
+
+    apply_motion(&out);
+}
+
+// Heights and velocities into x1000 fixed point, rounded. A cast: lrintf()
+// is a libm call on this target and the record path takes three.
+static inline int16_t trace_fixed(float v)
+{
+    return (int16_t)(v * MOTION_TRACE_SCALE + (v < 0 ? -0.5f : 0.5f));
+}
+
+// One control tick into the motion trace, while the motor runs and for a
+// short tail after it stopped. now_us is the tick's own timestamp, the
+// record does not read the timer again. The cycles a record takes go to
+// the trace cost statistics.
+static void trace_tick(const motion_input_t *in, const motion_output_t *out, uint32_t now_us)
+{
+    uint32_t start = esp_cpu_get_ccount();
+
+    if (motorRunning || motion_busy(&motion))
+        trace_tail = MOTION_TRACE_TAIL;
+    else if (trace_tail > 0)
+        trace_tail--;
+    else
+        return;
+
+    motion_trace_rec_t *r = motion_trace_next();
+    if (r == NULL)
+        return;
+
+    float target = motion.state == MOTION_GOTO || motion.state == MOTION_CAL_CENTER ? motion.ctrl.target
+                   : motion.state == MOTION_CAL_SEEK                                ? motion.seek_target
+                                                                                    : NAN;
+    int duty = motor_get_duty();
+    uint8_t flags = current_dir & MOTION_TRACE_DIR_MASK;
+
+    if (motorRunning)
+        flags |= MOTION_TRACE_RUNNING;
+    if (in->at_top)
+        flags |= MOTION_TRACE_AT_TOP;
+    if (in->at_bottom)
+        flags |= MOTION_TRACE_AT_BOTTOM;
+    if (in->trusted)
+        flags |= MOTION_TRACE_TRUSTED;
+    if (in->locked)
+        flags |= MOTION_TRACE_LOCKED;
+    if (stopping)
+        flags |= MOTION_TRACE_STOPPING;
+
+    r->timestamp_us = now_us;
+    r->height = trace_fixed(in->height);
+    r->target = isnan(target) ? MOTION_TRACE_NONE : trace_fixed(target);
+    r->velocity = trace_fixed(in->velocity);
+    r->duty = (int16_t)(current_dir == MOTOR_DIR_BACKWARD ? -duty : duty);
+    r->state = motion.state;
+    r->flags = flags;
+    r->events = out->events;
+    r->cmd = trace_cmd;
+    motion_trace_commit();
+    trace_cmd = MOTION_TRACE_NO_CMD;
+    motion_trace_add_cost(esp_cpu_get_ccount() - start);
+}
+
+// Parked on a switch after a normal move: refine that endpoint with the
+// height, less the run-out past the switch that its calibration capture
+// did not have
+static void learn_limit(bool top, float height, float speed)
+{
+    limit_learner_t *l = top ? &learn_top : &learn_bottom;
+    float coast = motion_model_coast_at(&motion_model, top, speed);
+    float anchor = motion_model_coast_at(&motion_model, top, anchor_speed[top]);
+    limit_learn_result_t r = limit_learn_observe(l, limit_learn_hit_height(top, height, coast, anchor));
+
+    if (r == LIMIT_LEARN_IGNORED)
+        return;
+
+    // printf("Limit %s: read %.2f at %.2f/s, -> %.2f%s\n", top ? "top" : "bottom", height, speed, l->limit,
+    //        r == LIMIT_LEARN_REJECTED ? " (outlier)" : r == LIMIT_LEARN_REBASED ? " (rebased)" : "");
+    dist_set_limits(learn_bottom.limit, learn_top.limit);
+}
+
+// NVS only sees the learned endpoints once they moved enough, and rarely
+static void save_learned_limits(void)
+{
+    float now_s = esp_timer_get_time() / 1000000.0f;
+
+    if (limit_learn_save_due(&learn_bottom, now_s))
+    {
+        save_limit("limit_bottom", learn_bottom.limit);
+        limit_learn_saved(&learn_bottom, now_s);
+    }
+    if (limit_learn_save_due(&learn_top, now_s))
+    {
+        save_limit("limit_top", learn_top.limit);
+        limit_learn_saved(&learn_top, now_s);
+    }
+}
+
+// An endpoint was corrected elsewhere: motor_task moves that limit by the
+// same amount, stores it and starts learning it again. The other end keeps
+// its live value, learned or not.
+void motor_shift_limit(bool top, float delta)
+{
+    portENTER_CRITICAL(&limit_shift_mux);
+    limit_shift[top] += delta;
+    portEXIT_CRITICAL(&limit_shift_mux);
+}
+
+static void apply_limit_shift(void)
+{
+    float shift[2];
+
+    portENTER_CRITICAL(&limit_shift_mux);
+    shift[0] = limit_shift[0];
+    shift[1] = limit_shift[1];
+    limit_shift[0] = limit_shift[1] = 0;
+    portEXIT_CRITICAL(&limit_shift_mux);
+
+    if (shift[0] == 0 && shift[1] == 0)
+        return;
+
+    float bottom, top;
+    dist_get_limits(&bottom, &top);
+    if (shift[0] != 0)
+    {
+        bottom += shift[0];
+        save_limit("limit_bottom", bottom);
+        limit_learn_init(&learn_bottom, &learn_cfg, bottom);
+    }
+    if (shift[1] != 0)
+    {
+        top += shift[1];
+        save_limit("limit_top", top);
+        limit_learn_init(&learn_top, &learn_cfg, top);
+    }
+    dist_set_limits(bottom, top);
 }
 
 void motor_task(void *arg)
 {
     motor_cmd_t cmd;
+    motion_input_t in = {0};
+    motion_output_t out;
+    const TickType_t period = pdMS_TO_TICKS(MOTION_TICK_MS);
+    TickType_t next_tick = xTaskGetTickCount() + period;
+    int64_t last = esp_timer_get_time();
+    float bottom, top;
+
+    dist_get_limits(&bottom, &top);
+    limit_learn_init(&learn_bottom, &learn_cfg, bottom);
+    limit_learn_init(&learn_top, &learn_cfg, top);
+    load_anchor_speeds();
+
     while (1)
     {
-        if (motorLockedLowSOC && motorRunning)
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = ((int32_t)(next_tick - now) > 0) ? next_tick - now : 0;
+
+        // Commands act as soon as they arrive, not on the next tick
+        if (xQueueReceive(motorQueue, &cmd, wait))
         {
-            motor_stop();
+            handle_command(cmd);
+            if ((int32_t)(xTaskGetTickCount() - next_tick) < 0)
+                continue;
         }
 
-        if (!calibrating) // disable safety during calibration
-        {
-            if (current_dir == MOTOR_DIR_FORWARD && hit_top_limit())
-                motor_stop();
+        next_tick += period;
+        if ((int32_t)(xTaskGetTickCount() - next_tick) > 0)
+            next_tick = xTaskGetTickCount() + period; // fell behind, do not burst
 
-            if (current_dir == MOTOR_DIR_BACKWARD && hit_bottom_limit())
-                motor_stop();
-        }
+        motor_ramp_tick();
 
-        if (xQueueReceive(motorQueue, &cmd, pdMS_TO_TICKS(10)))
+        // A limit ISR or the jog watchdog already cut the output: bring the
+        // driver state in line
+        if (ulTaskNotifyTake(pdTRUE, 0))
         {
-            last_cmd_time = xTaskGetTickCount();
-            switch (cmd)
-            {
-            case MOTOR_CMD_FORWARD:
-                if (!hit_top_limit())
-                {
-                    motor_forward();
-                }
-                else
-                {
-                    motor_stop();
-                }
-                break;
-            case MOTOR_CMD_BACKWARD:
-                if (!hit_bottom_limit())
-                {
-                    motor_backward();
-                }
-                else
-                {
-                    motor_stop();
-                }
-                break;
-            case MOTOR_CMD_STOP:
+            if (!motorRunning)
                 motor_stop();
-                break;
-            case MOTOR_CMD_GOTO_POSITION:
+
+            // A switch hit outside calibration is a free endpoint reading,
+            // taken once the idle filter has settled on the parked column
+            if (limit_hit_pin >= 0)
             {
-                int8_t theme = loadTheme();
-                display_set_page(theme == 1 ? 16 : 17);
-
-                //add page in Dwin with 2 dot please wait if pc not connected 
-                // if (pcConnected)
-                // {
-                //     display_set_page(theme == 1 ? 16 : 17);
-                // }
-                // else
-                // {
-                //     display_set_page(theme == 1 ? 21 : 18);
-                // }
-
-                move_to_position(target_position_mm);
-
-                if (pcConnected)
+                if (!motion_calibrating(&motion))
                 {
-                    display_set_page(theme == 1 ? 5 : 1);
+                    learn_pin = (gpio_num_t)limit_hit_pin;
+                    learn_speed = in.velocity; // last tick's, taken before the cut
+                    learn_tick = xTaskGetTickCount() + pdMS_TO_TICKS(LIMIT_LEARN_SETTLE_MS);
+                    if (learn_tick == 0)
+                        learn_tick = 1;
                 }
-                else
-                {
-                    display_set_page(theme == 1 ? 21 : 18);
-                }
-                break;
+                limit_hit_pin = -1;
             }
-
-            case MOTOR_CMD_SAVE_POSITION:
+            if (watchdog_fired)
             {
-                savePreset(selected_preset, current_height_mm);
-                // printf("Saving Presets\r\n");
-                int8_t theme = loadTheme();
-                display_set_page(theme == 1 ? 8 : 4);
-                beepHMI();
-                vTaskDelay(pdMS_TO_TICKS(1000));
-                if (pcConnected)
-                {
-                    display_set_page(theme == 1 ? 5 : 1);
-                }
-                else
-                {
-                    display_set_page(theme == 1 ? 21 : 18);
-                }
-                break;
+                watchdog_fired = false;
+                // printf("Jog watchdog stop\n");
+                read_motion_input(&in, 0);
+                out = motion_request(&motion, MOTION_REQ_STOP, 0, &in);
+                apply_motion(&out);
             }
+        }
+
+        follow_power_envelope();
+
+        int64_t t = esp_timer_get_time();
+        read_motion_input(&in, (t - last) / 1000000.0f);
+        last = t;
+
+        // Limits and the low-SOC lock are handled in the state machine and
+        // the jog release by the watchdog; this only catches output left
+        // running outside them
+        out = motion_tick(&motion, &in);
+        apply_motion(&out);
+        trace_tick(&in, &out, (uint32_t)t);
+        if (!motion_busy(&motion) && motorRunning &&
+            ((current_dir == MOTOR_DIR_FORWARD && in.at_top) ||
+             (current_dir == MOTOR_DIR_BACKWARD && in.at_bottom) || in.locked))
+        {
+            motor_stop();
+        }
 
-            case MOTOR_CMD_CALIBRATE:
-                // printf("Caliberating\r\n");
-                run_calibration();
-                break;
+        // Count down on the please-wait page, only when the second changes
+        if (motion.state == MOTION_GOTO)
+        {
+            int eta = (int)ceilf(motion_eta(&motion));
+            if (eta != eta_shown)
+            {
+                eta_shown = eta;
+                display_set_vp(DWIN_VP_ETA, eta);
             }
         }
 
-        // Stop Motor if Running without Que
-        if (motorRunning && (xTaskGetTickCount() - last_cmd_time) > pdMS_TO_TICKS(500))
+        apply_limit_shift();
+        if (learn_tick && (int32_t)(xTaskGetTickCount() - learn_tick) >= 0)
         {
-            motor_stop();
+            learn_tick = 0;
+            if (!motorRunning && !motion_calibrating(&motion) && gpio_get_level(learn_pin) && dist_sensor_trusted())
+                learn_limit(learn_pin == PROXIMITY_TOP, dist_height(), learn_speed);
+        }
+        save_learned_limits();
+
+        if (page_restore_tick && (int32_t)(xTaskGetTickCount() - page_restore_tick) >= 0)
+        {
+            page_restore_tick = 0;
+            show_home_page();
         }
     }
 }
 
 void start_motor_task()
 {
-    xTaskCreate(motor_task, "motor_task", 4096, NULL, 5, NULL);
+    xTaskCreate(motor_task, "motor_task", 4096, NULL, 5, &motorTaskHandle);
 }
\ No newline at end of file
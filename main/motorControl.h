@@ -10,18 +10,35 @@ extern QueueHandle_t motorQueue;
 #define SLP_PIN 47
 #define PWM_PIN 4
 
+#define LIMIT_CONFIRM_US 200 // a proximity edge must hold this long in the ISR before it cuts
+#define LIMIT_LEARN_SETTLE_MS 500 // after a switch hit, parked height read this much later to refine the endpoint
+
+// Jog drive, ramps are stepped by motor_task every MOTION_TICK_MS
+#define MOTOR_CRUISE_DUTY 1023
+#define MOTOR_RAMP_UP_MS 300    // soft start, 0 to cruise duty
+#define MOTOR_RAMP_DOWN_MS 200  // soft stop, cruise duty to 0
+#define MOTOR_CRUISE_SHARE 1.0f // closed-loop cruise as a share of the measured full-duty speed
+
+// Jog dead-man watchdog: every jog command re-arms a hardware timer, and the
+// output is cut from the timer callback when no repeat arrives in time.
+// Timeouts per command, 0 leaves the command unguarded.
+#define MOTOR_WDT_JOG_UP_MS 500
+#define MOTOR_WDT_JOG_DOWN_MS 500
+
 extern float target_position_mm;
 extern int8_t selected_preset;
-extern float current_height_mm;
 
 extern int8_t initial_calib;
-extern bool calibrating;
+extern volatile bool calibrating;
 // Motor direction
 typedef enum {
     MOTOR_DIR_FORWARD = 1,
     MOTOR_DIR_BACKWARD = 0
 } motor_direction_t;
 
+extern motor_direction_t current_dir;
+extern volatile bool motorRunning;
+
 typedef enum {
     MOTOR_CMD_FORWARD,
     MOTOR_CMD_BACKWARD,
@@ -32,6 +49,16 @@ typedef enum {
 } motor_cmd_t;
 
 
+// Proximity switch ISR statistics, latency is ISR entry to driver asleep and
+// includes the LIMIT_CONFIRM_US glitch filter
+typedef struct {
+    uint32_t count;    // cut-offs done from the ISR
+    uint32_t glitches; // edges met while driving into the switch that did not hold
+    uint32_t last_us;
+    uint32_t max_us;
+    uint32_t watchdog; // jogs cut by the dead-man watchdog
+} limit_stats_t;
+
 typedef enum {
     MOTOR_WAKE = 1,
     MOTOR_SLEEP = 0
@@ -41,6 +68,12 @@ void motorInit();
 void motor_forward();
 void motor_backward();
 void motor_stop(void);
+void motor_soft_stop(void);
+int motor_get_duty(void);
+float motor_commanded_velocity(void);
+void motor_load_model(void);
+void motor_get_limit_stats(limit_stats_t *out);
+void motor_shift_limit(bool top, float delta);
 void run_calibration();
 void start_motor_task();
 void beepHMI();
\ No newline at end of file
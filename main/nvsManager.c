@@ -143,6 +143,60 @@ float load_limit(const char *key)
     return f;
 }
 
+void save_blob(const char *key, const void *data, size_t len)
+{
+    nvs_handle_t h;
+    esp_err_t err;
+
+    err = nvs_open("settings", NVS_READWRITE, &h);
+    if (err != ESP_OK)
+    {
+        printf("NVS open failed\n");
+        return;
+    }
+
+    err = nvs_set_blob(h, key, data, len);
+    if (err != ESP_OK)
+    {
+        printf("NVS set failed: %s\n", esp_err_to_name(err));
+    }
+
+    nvs_commit(h);
+    nvs_close(h);
+
+    printf("Saved %s (%d bytes)\n", key, (int)len);
+}
+
+bool load_blob(const char *key, void *data, size_t len)
+{
+    nvs_handle_t h;
+    esp_err_t err;
+
+    err = nvs_open("settings", NVS_READONLY, &h);
+    if (err != ESP_OK)
+    {
+        printf("NVS open failed\n");
+        return false;
+    }
+
+    size_t required_size = len;
+    err = nvs_get_blob(h, key, data, &required_size);
+    nvs_close(h);
+
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        printf("%s not found in NVS\n", key);
+        return false;
+    }
+    else if (err != ESP_OK || required_size != len)
+    {
+        printf("NVS get %s failed\n", key);
+        return false;
+    }
+
+    return true;
+}
+
 void saveDevicename(const char *name)
 {
     nvs_handle_t h;
@@ -12,5 +12,8 @@ float loadPreset(int8_t id);
 void save_limit(const char *key, float value);
 float load_limit(const char *key);
 
+void save_blob(const char *key, const void *data, size_t len);
+bool load_blob(const char *key, void *data, size_t len);
+
 void saveDevicename(const char *name);
 bool loadDevicename(char *buffer, size_t buffer_size);
\ No newline at end of file
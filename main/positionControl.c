@@ -0,0 +1,144 @@
+#include "positionControl.h"
+#include <math.h>
+
+// `velocity` is the column's current rate, so a move that replaces another
+// one in the same direction carries on at speed instead of starting over
+void position_ctrl_start(position_ctrl_t *c, const position_cfg_t *cfg, float from, float velocity, float target)
+{
+    c->cfg = cfg;
+    c->sign = (target >= from) ? 1 : -1;
+    c->dir = (c->sign > 0) ? &cfg->up : &cfg->down;
+    c->target = target;
+    c->ref_pos = from;
+    c->ref_vel = velocity * c->sign;
+    if (c->ref_vel < 0)
+        c->ref_vel = 0;
+    if (c->ref_vel > c->dir->v_max)
+        c->ref_vel = c->dir->v_max;
+    c->ref_acc = 0;
+    c->integral = 0;
+    c->settled_s = 0;
+    c->done = fabsf(target - from) < cfg->tolerance;
+}
+
+// Advance the reference one tick: speed up towards cruise, but never faster
+// than what still allows stopping on the target at the deceleration rate
+static void plan(position_ctrl_t *c, float dt)
+{
+    const position_dir_cfg_t *d = c->dir;
+    float remaining = (c->target - c->ref_pos) * c->sign;
+
+    if (remaining <= 0)
+    {
+        c->ref_pos = c->target;
+        c->ref_vel = 0;
+        c->ref_acc = 0;
+        return;
+    }
+
+    float v = c->ref_vel + d->accel * dt;
+    float v_stop = sqrtf(2.0f * d->decel * remaining);
+
+    if (v > d->v_max)
+        v = d->v_max;
+    if (v > v_stop)
+        v = v_stop;
+
+    c->ref_acc = (dt > 0) ? (v - c->ref_vel) / dt : 0;
+    c->ref_vel = v;
+    c->ref_pos += c->sign * v * dt;
+    if ((c->target - c->ref_pos) * c->sign <= 0)
+    {
+        c->ref_pos = c->target;
+        c->ref_vel = 0;
+        c->ref_acc = 0;
+    }
+}
+
+// One control tick with the estimated height and velocity. Returns the duty
+// to apply, signed by direction, 0 once the column has settled on the target.
+int position_ctrl_step(position_ctrl_t *c, float height, float velocity, float dt)
+{
+    const position_cfg_t *cfg = c->cfg;
+
+    if (c->done)
+        return 0;
+
+    plan(c, dt);
+
+    // Arrival: reference finished and the column held inside the window
+    float error = c->ref_pos - height;
+    if (c->ref_vel == 0 && fabsf(c->target - height) < cfg->tolerance)
+    {
+        c->settled_s += dt;
+        if (c->settled_s >= cfg->settle_s)
+            c->done = true;
+        c->integral = 0;
+        return 0;
+    }
+    c->settled_s = 0;
+
+    // Gains of the direction the correction pushes in
+    const position_dir_cfg_t *d = (error > 0 || (error == 0 && c->sign > 0)) ? &cfg->up : &cfg->down;
+    float ref_vel = c->sign * c->ref_vel;
+    // The motor lags its command by ka, lead the velocity command to match
+    float ff_vel = ref_vel + c->sign * c->ref_acc * c->dir->ka;
+
+    c->integral += error * dt;
+    float i_term = c->dir->ki * c->integral;
+    if (i_term > cfg->i_limit)
+        c->integral = cfg->i_limit / c->dir->ki;
+    else if (i_term < -cfg->i_limit)
+        c->integral = -cfg->i_limit / c->dir->ki;
+
+    float duty = c->dir->kff * ff_vel + d->kp * error + c->dir->ki * c->integral +
+                 d->kd * (ref_vel - velocity);
+
+    // Below the stiction duty the column does not move at all
+    if (fabsf(duty) < d->min_duty)
+        duty = (duty > 0 || (duty == 0 && c->sign > 0)) ? d->min_duty : -d->min_duty;
+    if (duty > POS_DUTY_MAX)
+        duty = POS_DUTY_MAX;
+    if (duty < -POS_DUTY_MAX)
+        duty = -POS_DUTY_MAX;
+
+    return (int)duty;
+}
+
+bool position_ctrl_done(const position_ctrl_t *c)
+{
+    return c->done;
+}
+
+// Time the reference still needs to reach the target, plus the settle time.
+// Same profile as plan(): accelerate, cruise if there is room, decelerate.
+float position_ctrl_remaining_s(const position_ctrl_t *c)
+{
+    const position_dir_cfg_t *d = c->dir;
+    float remaining = (c->target - c->ref_pos) * c->sign;
+    float v0 = c->ref_vel;
+    float t;
+
+    if (c->done)
+        return 0;
+    if (remaining <= 0)
+        return c->cfg->settle_s;
+
+    if (v0 * v0 / (2.0f * d->decel) >= remaining)
+        t = v0 / d->decel; // already braking
+    else
+    {
+        // Peak speed of an accelerate-then-brake profile over the distance
+        float peak = sqrtf((2.0f * remaining + v0 * v0 / d->accel) / (1.0f / d->accel + 1.0f / d->decel));
+
+        if (peak <= d->v_max)
+            t = (peak - v0) / d->accel + peak / d->decel;
+        else
+        {
+            float ramps = (d->v_max * d->v_max - v0 * v0) / (2.0f * d->accel) +
+                          d->v_max * d->v_max / (2.0f * d->decel);
+            t = (d->v_max - v0) / d->accel + d->v_max / d->decel + (remaining - ramps) / d->v_max;
+        }
+    }
+    return t + c->cfg->settle_s;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// Closed-loop move to a target height. A trapezoidal reference (accelerate,
+// cruise, decelerate) is planned on the fly and tracked with feed-forward
+// plus PID; the output is a signed LEDC duty, + drives the column up.
+
+#define POS_DUTY_MAX 1023
+
+// Per direction, heights in sensor units (see dist.h), speeds per second
+typedef struct {
+    float v_max;    // cruise speed of the reference
+    float accel;    // reference acceleration
+    float decel;    // reference deceleration
+    float kff;      // duty per unit/s of reference velocity
+    float ka;       // motor time constant, reference acceleration is fed forward through it
+    float kp;       // duty per unit of position error
+    float ki;       // duty per unit*s of accumulated error
+    float kd;       // duty per unit/s of velocity error
+    float min_duty; // smallest duty that still moves the column
+} position_dir_cfg_t;
+
+typedef struct {
+    position_dir_cfg_t up;
+    position_dir_cfg_t down;
+    float tolerance;   // arrival window around the target
+    float settle_s;    // time the height must stay inside the window
+    float i_limit;     // clamp on the integral term, duty
+} position_cfg_t;
+
+// Full duty moves the column at 0.65/s (DIST_SPEED_UP/DOWN) and the
+// reference cruises at it, as the old full-duty move did, then brakes about
+// as hard as the motor lag allows. No integral: the feed-forward carries the
+// load and any wind-up shows as overshoot. Any tighter window and the
+// arrival hunts on sensor noise. Tuned with tools/position_sim.c.
+#define POSITION_CFG_DEFAULT {                                               \
+    .up = {.v_max = 0.65f, .accel = 4.0f, .decel = 6.0f, .kff = 1574.0f,    \
+           .ka = 0.16f, .kp = 6500.0f, .ki = 0.0f, .kd = 300.0f,            \
+           .min_duty = 250},                                                \
+    .down = {.v_max = 0.65f, .accel = 4.0f, .decel = 6.0f, .kff = 1574.0f,  \
+             .ka = 0.16f, .kp = 6500.0f, .ki = 0.0f, .kd = 300.0f,          \
+             .min_duty = 200},                                              \
+    .tolerance = 0.025f, .settle_s = 0.3f, .i_limit = 300.0f}
+
+typedef struct {
+    const position_cfg_t *cfg;
+    const position_dir_cfg_t *dir; // gains for the direction of the move
+    float target;
+    float ref_pos;     // reference position and velocity, + is towards the target
+    float ref_vel;
+    float ref_acc;
+    float integral;
+    float settled_s;
+    int8_t sign;       // +1 moving up, -1 moving down
+    bool done;
+} position_ctrl_t;
+
+void position_ctrl_start(position_ctrl_t *c, const position_cfg_t *cfg, float from, float velocity, float target);
+int position_ctrl_step(position_ctrl_t *c, float height, float velocity, float dt);
+bool position_ctrl_done(const position_ctrl_t *c);
+float position_ctrl_remaining_s(const position_ctrl_t *c);
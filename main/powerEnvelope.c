@@ -0,0 +1,45 @@
+#include "powerEnvelope.h"
+
+// Until the BMS answers the motor runs as it always did
+void power_envelope_init(power_envelope_t *e)
+{
+    e->share = 1.0f;
+    e->locked = false;
+    e->hot = false;
+}
+
+static float curve(const power_point_t *p, int n, float x)
+{
+    if (x <= p[0].at)
+        return p[0].share;
+
+    for (int i = 1; i < n; i++)
+    {
+        if (x < p[i].at)
+            return p[i - 1].share + (p[i].share - p[i - 1].share) * (x - p[i - 1].at) / (p[i].at - p[i - 1].at);
+    }
+    return p[n - 1].share;
+}
+
+// New BMS readings. Returns true when the share or the lock changed.
+bool power_envelope_update(power_envelope_t *e, const power_cfg_t *cfg, float soc, float temp_min, float temp_max)
+{
+    power_envelope_t before = *e;
+    float share = curve(cfg->soc, POWER_SOC_POINTS, soc);
+    float cold = curve(cfg->temp, POWER_TEMP_POINTS, temp_min);
+    float hot = curve(cfg->temp, POWER_TEMP_POINTS, temp_max);
+
+    if (cold < share)
+        share = cold;
+    if (hot < share)
+        share = hot;
+    e->share = share;
+
+    if (e->locked)
+        e->locked = soc < cfg->unlock_soc || temp_max >= cfg->unlock_temp;
+    else
+        e->locked = soc < cfg->lock_soc || temp_max >= cfg->lock_temp;
+    e->hot = e->locked && temp_max >= cfg->unlock_temp;
+
+    return e->share != before.share || e->locked != before.locked || e->hot != before.hot;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// Motor power the pack can take: a share of full duty and of the start-up
+// acceleration, derated as SOC falls and as the pack runs hot or cold, so a
+// weak pack still lifts, slowly, without full-duty inrush browning it out.
+// Free of ESP-IDF calls; the BMS task feeds it, motor_task applies it.
+
+#define POWER_SOC_POINTS 4
+#define POWER_TEMP_POINTS 6
+
+// One point of a derating curve, linear between points, flat past the ends
+typedef struct {
+    float at;     // SOC in % or temperature in °C, ascending along the curve
+    float share;  // of full duty and acceleration, 0..1
+} power_point_t;
+
+typedef struct {
+    power_point_t soc[POWER_SOC_POINTS];
+    power_point_t temp[POWER_TEMP_POINTS]; // read at both the coldest and the hottest sensor
+    float lock_soc;    // below this nothing moves
+    float unlock_soc;  // hysteresis, a lock lifts at or above this
+    float lock_temp;   // hottest sensor at or above this, nothing moves
+    float unlock_temp;
+} power_cfg_t;
+
+// Full power from 30 % down, a third of it at empty. Cold packs sag under
+// load, hot ones are spared. The floor still clears the stiction duty.
+#define POWER_CFG_DEFAULT {                                                      \
+    .soc = {{0.0f, 0.35f}, {10.0f, 0.5f}, {20.0f, 0.8f}, {30.0f, 1.0f}},         \
+    .temp = {{-10.0f, 0.5f}, {0.0f, 0.8f}, {10.0f, 1.0f},                        \
+             {45.0f, 1.0f}, {55.0f, 0.6f}, {60.0f, 0.35f}},                      \
+    .lock_soc = 1.0f, .unlock_soc = 3.0f, .lock_temp = 65.0f, .unlock_temp = 60.0f}
+
+typedef struct {
+    float share;  // of full duty and acceleration, 1 = no derating
+    bool locked;  // pack too empty or too hot to move at all
+    bool hot;     // the lock is held by temperature, charging will not lift it
+} power_envelope_t;
+
+void power_envelope_init(power_envelope_t *e);
+bool power_envelope_update(power_envelope_t *e, const power_cfg_t *cfg, float soc, float temp_min, float temp_max);
@@ -0,0 +1,89 @@
+#include "sensorHealth.h"
+#include "string.h"
+#include <math.h>
+
+void sensor_health_init(sensor_health_t *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->confidence = 100;
+}
+
+void sensor_health_sample(sensor_health_t *h, uint16_t raw, float distance)
+{
+    h->samples++;
+
+    if (raw >= HEALTH_SATURATED_RAW)
+        h->saturated++;
+
+    if (distance < 0)
+    {
+        h->invalid++;
+        return;
+    }
+
+    if (h->valid == 0)
+        h->first = distance;
+
+    float d = distance - h->first;
+    h->sum += d;
+    h->sum_sq += d * d;
+    h->valid++;
+}
+
+// Close the frame. `jump` is how far the new median landed from where the
+// estimator predicted it, over `dt` seconds. Confidence drops at once on a
+// bad frame and recovers over a few good ones.
+uint8_t sensor_health_frame(sensor_health_t *h, float jump, float dt)
+{
+    float score = 100;
+    uint8_t faults = 0;
+
+    if (h->samples > 0)
+    {
+        float invalid_ratio = (float)h->invalid / h->samples;
+        float saturated_ratio = (float)h->saturated / h->samples;
+
+        if (invalid_ratio > HEALTH_MAX_INVALID)
+            faults |= SENSOR_FAULT_DISCONNECTED;
+        if (saturated_ratio > HEALTH_MAX_SATURATED)
+            faults |= SENSOR_FAULT_SATURATED;
+
+        score -= 100 * (invalid_ratio + saturated_ratio);
+    }
+    else
+    {
+        faults |= SENSOR_FAULT_DISCONNECTED;
+    }
+
+    if (h->valid > 1)
+    {
+        float mean = h->sum / h->valid;
+        float variance = h->sum_sq / h->valid - mean * mean;
+
+        if (variance > HEALTH_MAX_VARIANCE)
+        {
+            faults |= SENSOR_FAULT_NOISY;
+            score -= 50;
+        }
+    }
+
+    if (fabsf(jump) > HEALTH_MAX_RATE * dt + HEALTH_JUMP_MARGIN)
+    {
+        faults |= SENSOR_FAULT_IMPLAUSIBLE;
+        score -= 50;
+    }
+
+    if (score < 0)
+        score = 0;
+
+    if (score < h->confidence)
+        h->confidence = (uint8_t)score;
+    else
+        h->confidence += ((uint8_t)score - h->confidence + 3) / 4;
+
+    h->faults = faults;
+    h->samples = h->invalid = h->saturated = h->valid = 0;
+    h->sum = h->sum_sq = 0;
+
+    return h->confidence;
+}
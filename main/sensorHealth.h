@@ -0,0 +1,37 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// Online IR sensor health. Counters are fed per sample and turned into a
+// 0-100 confidence once per frame; every step is a handful of operations.
+
+#define HEALTH_SATURATED_RAW 4000   // codes at/above this mean the sensor output is pinned high
+#define HEALTH_MAX_INVALID 0.5f     // invalid sample ratio that flags a disconnect
+#define HEALTH_MAX_SATURATED 0.2f   // saturated sample ratio that flags saturation
+#define HEALTH_MAX_VARIANCE 0.25f   // per-frame variance of valid samples (0.5 std dev)
+#define HEALTH_MAX_RATE 5.0f        // fastest believable height change, per second
+#define HEALTH_JUMP_MARGIN 0.3f     // noise allowance on top of HEALTH_MAX_RATE * dt
+
+#define SENSOR_FAULT_DISCONNECTED 0x01
+#define SENSOR_FAULT_SATURATED 0x02
+#define SENSOR_FAULT_NOISY 0x04
+#define SENSOR_FAULT_IMPLAUSIBLE 0x08
+
+typedef struct {
+    // per-frame accumulators
+    uint16_t samples;
+    uint16_t invalid;
+    uint16_t saturated;
+    uint16_t valid;
+    float first; // valid samples are accumulated relative to the first one
+    float sum;
+    float sum_sq;
+
+    // result of the last completed frame
+    uint8_t confidence;
+    uint8_t faults;
+} sensor_health_t;
+
+void sensor_health_init(sensor_health_t *h);
+void sensor_health_sample(sensor_health_t *h, uint16_t raw, float distance);
+uint8_t sensor_health_frame(sensor_health_t *h, float jump, float dt);
@@ -0,0 +1,54 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Single-writer sequence lock for small records shared between tasks/cores.
+// The writer makes the counter odd while it updates the record; readers copy
+// the record and retry if the counter was odd or moved underneath them.
+// The writer never blocks. A reader that finds the writer mid-update spins
+// briefly (the other core finishes a record in well under a microsecond),
+// then yields: writer and readers are unpinned tasks of equal priority, and
+// a writer time-sliced out on the reader's own core only gets back on by
+// the reader giving way. Task context only.
+
+#define SEQLOCK_SPIN 64 // reads of an odd counter before the reader yields
+
+typedef struct {
+    volatile uint32_t seq;
+} seqlock_t;
+
+static inline void seqlock_write_begin(seqlock_t *l)
+{
+    __atomic_store_n(&l->seq, l->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqlock_write_end(seqlock_t *l)
+{
+    __atomic_store_n(&l->seq, l->seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t seqlock_read_begin(const seqlock_t *l)
+{
+    uint32_t seq;
+    int spins = 0;
+
+    while ((seq = __atomic_load_n(&l->seq, __ATOMIC_ACQUIRE)) & 1)
+    {
+        // writer in progress
+        if (++spins == SEQLOCK_SPIN)
+        {
+            spins = 0;
+            taskYIELD();
+        }
+    }
+    return seq;
+}
+
+static inline bool seqlock_read_retry(const seqlock_t *l, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&l->seq, __ATOMIC_RELAXED) != seq;
+}
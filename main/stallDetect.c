@@ -0,0 +1,56 @@
+#include "stallDetect.h"
+#include <math.h>
+
+void stall_init(stall_detector_t *d, const stall_cfg_t *cfg)
+{
+    d->cfg = cfg;
+    stall_reset(d);
+}
+
+// Forget the current window, e.g. when the height cannot be trusted
+void stall_reset(stall_detector_t *d)
+{
+    d->velocity = 0;
+    d->expected = 0;
+    d->elapsed_s = 0;
+    d->armed = false;
+    d->tracking = false;
+}
+
+// One control tick. True when a full window went by with the column well
+// short of the travel the drive should have produced. The expected velocity
+// starts from the measured one, so a move that begins while the column is
+// still coasting the other way is not taken for a stall.
+bool stall_update(stall_detector_t *d, float commanded_velocity, float velocity, float height, float dt)
+{
+    const stall_cfg_t *cfg = d->cfg;
+
+    if (!d->tracking)
+    {
+        d->velocity = velocity;
+        d->tracking = true;
+    }
+
+    if (!d->armed)
+    {
+        d->start_height = height;
+        d->expected = 0;
+        d->elapsed_s = 0;
+        d->armed = true;
+    }
+
+    float k = (cfg->tau > dt) ? dt / cfg->tau : 1.0f;
+    d->velocity += (commanded_velocity - d->velocity) * k;
+    d->expected += d->velocity * dt;
+    d->elapsed_s += dt;
+
+    if (d->elapsed_s < cfg->window_s)
+        return false;
+
+    // Judge the window, then start the next one from here
+    float expected = fabsf(d->expected);
+    float actual = (height - d->start_height) * (d->expected >= 0 ? 1.0f : -1.0f);
+    d->armed = false;
+
+    return expected >= cfg->min_expected && actual < cfg->min_ratio * expected;
+}
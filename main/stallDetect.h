@@ -0,0 +1,35 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// Stall/obstruction detection for the motion loop. Travel expected from the
+// duty being driven (through the motor time constant) is compared with the
+// travel the height sensor reports, over back-to-back windows. Constant cost
+// per tick, no history kept.
+
+typedef struct {
+    float window_s;     // no-progress window
+    float min_ratio;    // stalled when actual travel is below this share of the expected
+    float min_expected; // windows expecting less travel than this are not judged
+    float tau;          // motor time constant, seconds
+    float backoff_s;    // reverse this long after a stall, 0 = just stop
+    int backoff_duty;   // duty used to back off
+} stall_cfg_t;
+
+#define STALL_CFG_DEFAULT {                                     \
+    .window_s = 0.5f, .min_ratio = 0.3f, .min_expected = 0.1f, \
+    .tau = 0.15f, .backoff_s = 0.3f, .backoff_duty = 600}
+
+typedef struct {
+    const stall_cfg_t *cfg;
+    float velocity;     // expected column velocity, lags the command by tau
+    float expected;     // expected travel in the current window
+    float start_height; // height at the start of the window
+    float elapsed_s;
+    bool armed;         // a window is open
+    bool tracking;      // velocity follows the command since the last reset
+} stall_detector_t;
+
+void stall_init(stall_detector_t *d, const stall_cfg_t *cfg);
+void stall_reset(stall_detector_t *d);
+bool stall_update(stall_detector_t *d, float commanded_velocity, float velocity, float height, float dt);
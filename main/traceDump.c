@@ -0,0 +1,113 @@
+#include "traceDump.h"
+#include "PC_DATA.h"
+#include "esp_partition.h"
+
+#define TRACE_BLOCK 256
+
+static uint8_t sum_bytes(uint8_t sum, const void *data, uint32_t len)
+{
+    const uint8_t *p = data;
+
+    while (len--)
+        sum += *p++;
+    return sum;
+}
+
+static trace_header_t make_header(uint8_t type, uint8_t rec_size, const trace_run_t *runs, int n)
+{
+    trace_header_t h = {.type = type, .rec_size = rec_size};
+
+    memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+    for (int i = 0; i < n; i++)
+        h.count += runs[i].count;
+    return h;
+}
+
+// Raw binary on the PC link. The console shares UART0, so the host tool
+// looks for the magic rather than assuming the stream is clean.
+bool trace_dump_uart(uint8_t type, uint8_t rec_size, const trace_run_t *runs, int n)
+{
+    trace_header_t h = make_header(type, rec_size, runs, n);
+    uint8_t sum = sum_bytes(0, &h, sizeof(h));
+
+    uart_write_bytes(PC_UART, (const char *)&h, sizeof(h));
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t len = runs[i].count * rec_size;
+
+        sum = sum_bytes(sum, runs[i].data, len);
+        uart_write_bytes(PC_UART, runs[i].data, len);
+    }
+    uart_write_bytes(PC_UART, (const char *)&sum, 1);
+    uart_wait_tx_done(PC_UART, portMAX_DELAY);
+    return true;
+}
+
+// Same image into the otherwise unused storage partition, survives a reboot
+bool trace_save_partition(uint8_t type, uint8_t rec_size, const trace_run_t *runs, int n)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           ESP_PARTITION_SUBTYPE_ANY, TRACE_PARTITION);
+    trace_header_t h = make_header(type, rec_size, runs, n);
+    uint32_t size = sizeof(h) + h.count * rec_size + 1;
+
+    if (part == NULL || size > part->size)
+    {
+        printf("Trace does not fit the %s partition\n", TRACE_PARTITION);
+        return false;
+    }
+
+    if (esp_partition_erase_range(part, 0, (size + 4095) & ~4095u) != ESP_OK)
+        return false;
+
+    uint8_t sum = sum_bytes(0, &h, sizeof(h));
+    uint32_t offset = sizeof(h);
+
+    if (esp_partition_write(part, 0, &h, sizeof(h)) != ESP_OK)
+        return false;
+
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t len = runs[i].count * rec_size;
+
+        if (esp_partition_write(part, offset, runs[i].data, len) != ESP_OK)
+            return false;
+        sum = sum_bytes(sum, runs[i].data, len);
+        offset += len;
+    }
+
+    return esp_partition_write(part, offset, &sum, 1) == ESP_OK;
+}
+
+// Send a trace saved by trace_save_partition() to the PC
+bool trace_dump_partition(void)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           ESP_PARTITION_SUBTYPE_ANY, TRACE_PARTITION);
+    static uint8_t block[TRACE_BLOCK];
+    trace_header_t h;
+
+    if (part == NULL || esp_partition_read(part, 0, &h, sizeof(h)) != ESP_OK)
+        return false;
+
+    if (memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) != 0)
+    {
+        printf("No trace saved in %s\n", TRACE_PARTITION);
+        return false;
+    }
+
+    uint32_t size = sizeof(h) + h.count * h.rec_size + 1;
+    if (size > part->size)
+        return false;
+
+    for (uint32_t offset = 0; offset < size; offset += TRACE_BLOCK)
+    {
+        uint32_t len = size - offset < TRACE_BLOCK ? size - offset : TRACE_BLOCK;
+
+        if (esp_partition_read(part, offset, block, len) != ESP_OK)
+            return false;
+        uart_write_bytes(PC_UART, (const char *)block, len);
+    }
+    uart_wait_tx_done(PC_UART, portMAX_DELAY);
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+// Binary trace framing shared by the recorders, decoded by tools/:
+// header, count records oldest first, then the 8-bit sum of everything before it
+#define TRACE_MAGIC           "TRC1"
+#define TRACE_TYPE_ADC        1
+#define TRACE_TYPE_MOTION     2
+
+#define TRACE_PARTITION       "storage"
+
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint8_t type;
+    uint8_t rec_size;
+    uint16_t reserved;
+    uint32_t count;
+} trace_header_t;
+
+// A ring is dumped as up to two contiguous runs of records
+typedef struct {
+    const void *data;
+    uint32_t count;
+} trace_run_t;
+
+bool trace_dump_uart(uint8_t type, uint8_t rec_size, const trace_run_t *runs, int n);
+bool trace_save_partition(uint8_t type, uint8_t rec_size, const trace_run_t *runs, int n);
+bool trace_dump_partition(void);
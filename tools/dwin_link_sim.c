@@ -0,0 +1,212 @@
+/*
+ * Host bench for the DWIN write path: main/dwinShadow.c feeding
+ * main/dwinTx.c over a simulated 9600 baud link to a panel that drops
+ * corrupted frames and answers the others with an in-order OK, which can
+ * be corrupted too. Fields change at random for a while, then the link
+ * goes quiet and the panel memory is compared with the shadow. Runs once
+ * with ACK tracking and once without.
+ *
+ * Build:
+ *   gcc -O2 -Wall -Imain -o dwin_link_sim tools/dwin_link_sim.c main/dwinShadow.c main/dwinTx.c
+ *
+ * Usage: dwin_link_sim [-l loss] [-t seconds] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dwinShadow.h"
+#include "dwinTx.h"
+
+#define FIELDS 20
+#define FLUSH_US 100000     // DISPLAY_FLUSH_MS
+#define BUDGET 72           // DISPLAY_BUDGET_BYTES
+#define POLL_US 20000       // dwin_rx_task read timeout
+#define PANEL_US 2000       // panel processing before its reply
+#define QUEUE_MAX 256
+
+typedef struct {
+    int64_t at_us;  // arrival time at the far end
+    bool ack;       // OK to the MCU, else a write to the panel
+    bool corrupt;
+    uint8_t len;
+    uint8_t data[DWIN_TX_FRAME_MAX];
+} wire_t;
+
+static wire_t wire[QUEUE_MAX];
+static int wire_n;
+static int64_t now_us, tx_free_us, rx_free_us;
+static uint8_t panel[0x20000];   // panel VP memory, byte addressed
+static float loss = 0.02f;
+static bool tracking;
+static dwin_shadow_t shadow;
+static dwin_tx_t tx;
+static uint32_t frames_lost, acks_lost;
+
+static float rnd(void)
+{
+    return rand() / (RAND_MAX + 1.0f);
+}
+
+static void wire_push(bool ack, const uint8_t *data, size_t len, int64_t *free_us)
+{
+    int64_t start = *free_us > now_us ? *free_us : now_us;
+
+    if (wire_n == QUEUE_MAX)
+    {
+        fprintf(stderr, "wire queue full at %.3f s\n", now_us / 1e6);
+        exit(1);
+    }
+    wire_t *w = &wire[wire_n++];
+
+    *free_us = start + (int64_t)len * DWIN_TX_BYTE_US;
+    w->at_us = *free_us + (ack ? 0 : PANEL_US);
+    w->ack = ack;
+    w->corrupt = rnd() < loss;
+    w->len = len;
+    memcpy(w->data, data, len);
+}
+
+// Deliver whatever arrived by now, in order
+static void step(void)
+{
+    int i = 0;
+
+    while (i < wire_n)
+    {
+        wire_t w = wire[i];
+
+        if (w.at_us > now_us)
+        {
+            i++;
+            continue;
+        }
+        memmove(&wire[i], &wire[i + 1], (--wire_n - i) * sizeof(wire[0]));
+
+        if (w.ack)
+        {
+            if (w.corrupt)
+                acks_lost++;
+            else if (tracking && dwin_tx_ack(&tx))
+                dwin_shadow_forget(&shadow);
+            continue;
+        }
+        if (w.corrupt)
+        {
+            frames_lost++;
+            continue;
+        }
+        memcpy(&panel[2 * ((w.data[4] << 8) | w.data[5])], &w.data[6], w.len - 6);
+        static const uint8_t ok[] = {0x5A, 0xA5, 0x03, 0x82, 0x4F, 0x4B};
+        wire_push(true, ok, sizeof(ok), &rx_free_us);
+    }
+}
+
+static void resend(const uint8_t *frame, size_t len, void *ctx)
+{
+    wire_push(false, frame, len, &tx_free_us);
+}
+
+static void poll(void)
+{
+    step();
+    if (tracking && dwin_tx_poll(&tx, now_us, resend, NULL) == DWIN_TX_LOST)
+        dwin_shadow_forget(&shadow);
+}
+
+// display_task's writer: waits for room in the window, as dwin_write() does
+static void send(const uint8_t *frame, size_t len, void *ctx)
+{
+    while (tracking && !dwin_tx_room(&tx))
+    {
+        now_us += 1000;
+        if (now_us % POLL_US < 1000)
+            poll();
+        else
+            step();
+    }
+    wire_push(false, frame, len, &tx_free_us);
+    if (tracking)
+        dwin_tx_sent(&tx, frame, len, true, now_us);
+}
+
+static int run(double seconds, int seed)
+{
+    char text[16];
+
+    srand(seed);
+    memset(panel, 0, sizeof(panel));
+    wire_n = 0;
+    now_us = tx_free_us = rx_free_us = 0;
+    frames_lost = acks_lost = 0;
+    dwin_shadow_init(&shadow);
+    dwin_tx_init(&tx);
+
+    int64_t end_us = (int64_t)(seconds * 1e6), next_flush = 0, next_poll = 0;
+    while (now_us < end_us + 3000000)
+    {
+        if (now_us >= next_flush)
+        {
+            // A few fields change every flush while the run lasts
+            for (int k = 0; now_us < end_us && k < 3; k++)
+            {
+                int f = rand() % FIELDS;
+                snprintf(text, sizeof(text), "%-5d", rand() % 1000);
+                dwin_shadow_write(&shadow, 0x1000 + f * 0x100, text, 5);
+            }
+            dwin_shadow_flush(&shadow, BUDGET, send, NULL);
+            next_flush = now_us + FLUSH_US;
+        }
+        if (now_us >= next_poll)
+        {
+            poll();
+            next_poll = now_us + POLL_US;
+        }
+        step();
+        now_us += 1000;
+    }
+
+    int wrong = 0;
+    for (int i = 0; i < shadow.count; i++)
+    {
+        const dwin_shadow_entry_t *e = &shadow.entry[i];
+        if (memcmp(&panel[2 * e->addr], e->data, e->len) != 0)
+            wrong++;
+    }
+    return wrong;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 600;
+    int opt, seed = 1;
+
+    while ((opt = getopt(argc, argv, "l:t:s:")) != -1)
+    {
+        if (opt == 'l')
+            loss = atof(optarg);
+        else if (opt == 't')
+            seconds = atof(optarg);
+        else if (opt == 's')
+            seed = atoi(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-l loss] [-t seconds] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%.0f s, %.1f %% of frames and ACKs corrupted, %d fields\n\n", seconds, loss * 100, FIELDS);
+    printf("%-12s %6s %7s %7s %8s %8s %6s %6s\n", "", "frames", "f_lost", "a_lost", "timeouts", "resent",
+           "lost", "wrong");
+
+    for (int i = 0; i < 2; i++)
+    {
+        tracking = (i == 1);
+        int wrong = run(seconds, seed);
+        printf("%-12s %6u %7u %7u %8u %8u %6u %6d\n", tracking ? "ack window" : "fire&forget", shadow.frames,
+               frames_lost, acks_lost, tx.timeouts, tx.retransmits, tx.lost, wrong);
+    }
+    return 0;
+}
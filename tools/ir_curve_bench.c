@@ -0,0 +1,113 @@
+/*
+ * Host bench for the IR curve table in main/irCurve.c against the per-sample
+ * powf() conversion it replaced. Every ADC code is converted both ways and
+ * the error is reported per height band; then random codes, as the sampler
+ * sees them, are converted in a loop to compare the cost per sample.
+ *
+ * Build:
+ *   gcc -O2 -Wall -Imain -o ir_curve_bench tools/ir_curve_bench.c main/irCurve.c -lm
+ *
+ * Usage: ir_curve_bench [-n samples]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "irCurve.h"
+
+// Dist.c before the table
+static float old_distance(uint32_t raw)
+{
+    float voltage = (raw / 4095.0f) * 3.3f;
+
+    if (voltage < 0.1f)
+        return -1;
+    float distance_cm = 12.08f * powf(voltage, -1.058f);
+    distance_cm -= 0.20f;
+    return distance_cm;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    static const float bands[] = {5, 10, 25, 50, 1e9}; // upper height of each band
+    int samples = 10000000, opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        if (opt == 'n')
+            samples = atoi(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    ir_curve_init();
+
+    // Accuracy over every code
+    double worst[5] = {0}, sum[5] = {0};
+    int count[5] = {0}, validity = 0;
+
+    for (uint32_t raw = 0; raw <= IR_ADC_MAX; raw++)
+    {
+        float ref = old_distance(raw), got = ir_curve_distance(raw);
+
+        if ((ref < 0) != (got < 0))
+            validity++;
+        if (ref < 0 || got < 0)
+            continue;
+
+        int b = 0;
+        while (ref > bands[b])
+            b++;
+        double e = fabs(got - ref);
+        sum[b] += e;
+        count[b]++;
+        if (e > worst[b])
+            worst[b] = e;
+    }
+
+    printf("codes whose validity differs: %d\n\n", validity);
+    printf("%-12s %6s %10s %10s\n", "height", "codes", "mean err", "max err");
+    for (int b = 0; b < 5; b++)
+    {
+        char name[16];
+        if (bands[b] > 1e8)
+            snprintf(name, sizeof(name), "> %.0f", bands[b - 1]);
+        else
+            snprintf(name, sizeof(name), "%.0f - %.0f", b ? bands[b - 1] : 0, bands[b]);
+        printf("%-12s %6d %10.5f %10.5f\n", name, count[b], count[b] ? sum[b] / count[b] : 0, worst[b]);
+    }
+
+    // Cost over random codes
+    uint16_t *in = malloc(samples * sizeof(uint16_t));
+    volatile float sink = 0;
+
+    srand(1);
+    for (int i = 0; i < samples; i++)
+        in[i] = rand() % (IR_ADC_MAX + 1);
+
+    double t0 = now_s();
+    for (int i = 0; i < samples; i++)
+        sink += old_distance(in[i]);
+    double t_old = (now_s() - t0) / samples;
+
+    t0 = now_s();
+    for (int i = 0; i < samples; i++)
+        sink += ir_curve_distance(in[i]);
+    double t_new = (now_s() - t0) / samples;
+
+    printf("\npowf %.2f ns/sample, table %.2f ns/sample, %.1fx\n", t_old * 1e9, t_new * 1e9, t_old / t_new);
+    free(in);
+    return 0;
+}
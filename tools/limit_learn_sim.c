@@ -0,0 +1,149 @@
+/*
+ * Host bench for the online endpoint learning in main/limitLearn.c. A switch
+ * hit is simulated every few minutes: most at jog speed, the rest slower.
+ * The column runs out past the switch edge in proportion to its speed, so
+ * the height read while parked on it is the edge plus that coast plus
+ * noise, with occasional wild readings. The stored endpoint is where the
+ * calibration capture parks: after the slow approach, or with -a 1 after a
+ * full-duty sweep. The true end drifts slowly and jumps once (switch
+ * bracket moved). Reports the endpoint error of the stored value without
+ * learning, learning from the raw parked height, learning with the coast
+ * taken off against the capture speed as motor_task does, and against an
+ * assumed slow approach, and the NVS writes.
+ *
+ * Build:
+ *   gcc -O2 -Wall -Imain -o limit_learn_sim tools/limit_learn_sim.c main/limitLearn.c \
+ *       main/motionModel.c -lm
+ *
+ * Usage: limit_learn_sim [-d days] [-h hits_per_hour] [-n noise] [-o outlier_rate] [-c coast]
+ *                        [-a capture_share] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include "limitLearn.h"
+#include "motionModel.h"
+#include "motionControl.h"
+
+#define END_START   4.0f     // true endpoint at the last calibration
+#define DRIFT_DAY   0.02f    // slow drift of the true endpoint per day
+#define JUMP        0.5f     // one step change half way through
+#define JOG_SHARE   0.7f     // hits at full jog speed, the rest at 30-100 % of it
+#define SPEED_NOISE 0.05f    // relative error of the speed read before the cut
+
+static float rnd(void)
+{
+    return rand() / (RAND_MAX + 1.0f);
+}
+
+static float gauss(void)
+{
+    float u = (rand() + 1.0f) / (RAND_MAX + 2.0f), v = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+    return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * v);
+}
+
+int main(int argc, char **argv)
+{
+    static const limit_learn_cfg_t cfg = LIMIT_LEARN_CFG_DEFAULT;
+    double days = 30, hits_per_hour = 4;
+    static const motion_model_t model = MOTION_MODEL_DEFAULT;
+    float noise = 0.03f, outlier_rate = 0.05f, coast_full = 0.098f; // motion_sim's measured coast
+    float capture_share = MOTION_CAL_APPROACH_DUTY / 1023.0f;       // capture speed, share of full
+    int opt, seed = 1;
+
+    while ((opt = getopt(argc, argv, "d:h:n:o:c:a:s:")) != -1)
+    {
+        if (opt == 'd')
+            days = atof(optarg);
+        else if (opt == 'h')
+            hits_per_hour = atof(optarg);
+        else if (opt == 'n')
+            noise = atof(optarg);
+        else if (opt == 'o')
+            outlier_rate = atof(optarg);
+        else if (opt == 'c')
+            coast_full = atof(optarg);
+        else if (opt == 'a')
+            capture_share = atof(optarg);
+        else if (opt == 's')
+            seed = atoi(optarg);
+        else
+        {
+            fprintf(stderr,
+                    "usage: %s [-d days] [-h hits_per_hour] [-n noise] [-o outlier_rate] [-c coast] [-a capture_share] "
+                    "[-s seed]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+    // Top end, hits drive up into it. The stored endpoint includes the
+    // coast of the calibration capture.
+    float v_full = motion_model_speed(&model, true);
+    float approach = MOTION_CAL_APPROACH_DUTY / 1023.0f * v_full;
+    float capture = capture_share * v_full;
+    float anchor_coast = coast_full * capture / v_full;
+    limit_learner_t l, raw, assumed;
+    limit_learn_init(&l, &cfg, END_START + anchor_coast);
+    limit_learn_init(&raw, &cfg, END_START + anchor_coast);
+    limit_learn_init(&assumed, &cfg, END_START + anchor_coast);
+
+    double end_s = days * 86400, t = 0;
+    double err_fixed = 0, err_raw = 0, err_learned = 0, err_saved = 0, err_assumed = 0, worst_learned = 0;
+    int hits = 0, writes = 0, rejected = 0, rebased = 0;
+
+    while (t < end_s)
+    {
+        t += -logf(1.0f - rnd()) * 3600 / hits_per_hour;
+        float edge = END_START + DRIFT_DAY * t / 86400 + (t > end_s / 2 ? JUMP : 0);
+        float truth = edge + anchor_coast;
+        float speed = v_full * (rnd() < JOG_SHARE ? 1.0f : 0.3f + 0.7f * rnd());
+        float reading = edge + coast_full * speed / v_full + noise * gauss();
+        float measured = speed * (1 + SPEED_NOISE * gauss());
+
+        if (rnd() < outlier_rate)
+            reading += (rnd() - 0.5f) * 2.0f;
+
+        limit_learn_observe(&raw, reading);
+
+        float coast = motion_model_coast_at(&model, true, measured);
+        float anchor = motion_model_coast_at(&model, true, capture);
+        limit_learn_result_t r = limit_learn_observe(&l, limit_learn_hit_height(true, reading, coast, anchor));
+        limit_learn_observe(&assumed, limit_learn_hit_height(true, reading, coast,
+                                                             motion_model_coast_at(&model, true, approach)));
+        if (r == LIMIT_LEARN_REJECTED)
+            rejected++;
+        if (r == LIMIT_LEARN_REBASED)
+            rebased++;
+        if (limit_learn_save_due(&l, t))
+        {
+            limit_learn_saved(&l, t);
+            writes++;
+        }
+
+        // Error as seen by the next move, after this hit was folded in
+        float e = fabsf(l.limit - truth);
+        hits++;
+        err_fixed += fabsf(END_START + anchor_coast - truth);
+        err_raw += fabsf(raw.limit - truth);
+        err_learned += e;
+        err_saved += fabsf(l.saved - truth);
+        err_assumed += fabsf(assumed.limit - truth);
+        if (e > worst_learned && t > end_s / 2 + 3 * 3600)
+            worst_learned = e;
+    }
+
+    printf("%.0f days, %.1f hits/h, noise %.3f, outliers %.0f %%, coast %.3f at full speed, captured at %.0f %%\n\n",
+           days, hits_per_hour, noise, outlier_rate * 100, coast_full, capture_share * 100);
+    printf("switch hits        %d (rejected %d, rebased %d)\n", hits, rejected, rebased);
+    printf("mean error fixed   %.3f\n", err_fixed / hits);
+    printf("mean error raw     %.3f (parked height, coast left in)\n", err_raw / hits);
+    printf("mean error learned %.3f (in NVS %.3f)\n", err_learned / hits, err_saved / hits);
+    printf("mean error assumed %.3f (capture taken as the slow approach)\n", err_assumed / hits);
+    printf("worst learned, 3 h after the jump on  %.3f\n", worst_learned);
+    printf("NVS writes         %d (%.1f per day)\n", writes, writes / days);
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Host bench for the sliding median in main/medianFilter.c against the
+ * bubble-sort median_filter() it replaced. Random IR readings with runs of
+ * -1 (failed conversions) are pushed through both: the old function sorts a
+ * copy of the last n samples at every sample, gaps included, the window
+ * skips the gaps. Checks the window against a sort of the valid samples and
+ * reports how often the old function was pulled off by the gaps, and the
+ * cost per sample of each.
+ *
+ * Build:
+ *   gcc -O2 -Wall -Imain -o median_bench tools/median_bench.c main/medianFilter.c
+ *
+ * Usage: median_bench [-n samples] [-g gap_rate] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "medianFilter.h"
+
+// Dist.c before the window, sorts v in place
+static float median_filter(float *v, int n)
+{
+    for (int i = 0; i < n - 1; i++)
+        for (int j = i + 1; j < n; j++)
+            if (v[j] < v[i])
+            {
+                float tmp = v[i];
+                v[i] = v[j];
+                v[j] = tmp;
+            }
+
+    return v[n / 2];
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static float rnd(void)
+{
+    return rand() / (RAND_MAX + 1.0f);
+}
+
+// Slow drift plus noise and the odd spike, -1 in runs at gap_rate
+static void make_input(float *in, int n, float gap_rate)
+{
+    float level = 2000;
+    int gap = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        level += (rnd() - 0.5f) * 4;
+        if (gap == 0 && rnd() < gap_rate / 3)
+            gap = 1 + rand() % 5;
+        if (gap > 0)
+        {
+            gap--;
+            in[i] = -1;
+        }
+        else
+            in[i] = (int)(level + (rnd() - 0.5f) * 60 + (rnd() < 0.02f ? 800 : 0));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const int windows[] = {11, 25, 63}; // boot poll, DIST_MOVING_WINDOW, DIST_IDLE_WINDOW
+    int samples = 200000, opt, seed = 1;
+    float gap_rate = 0.05f;
+
+    while ((opt = getopt(argc, argv, "n:g:s:")) != -1)
+    {
+        if (opt == 'n')
+            samples = atoi(optarg);
+        else if (opt == 'g')
+            gap_rate = atof(optarg);
+        else if (opt == 's')
+            seed = atoi(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-n samples] [-g gap_rate] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+    float *in = malloc(samples * sizeof(float));
+    make_input(in, samples, gap_rate);
+
+    printf("%d samples, %.0f %% in gaps of -1\n\n", samples, gap_rate * 100);
+    printf("%6s %10s %10s %12s %12s %8s\n", "window", "mismatch", "old_gap", "old ns/smp", "new ns/smp", "speedup");
+
+    for (size_t k = 0; k < sizeof(windows) / sizeof(windows[0]); k++)
+    {
+        int n = windows[k];
+        float v[MEDIAN_WINDOW_MAX], valid[MEDIAN_WINDOW_MAX];
+        int mismatch = 0, old_gap = 0;
+        volatile float sink = 0;
+        median_window_t w;
+
+        // Correctness: the window against a sort of the valid samples
+        median_window_init(&w, n);
+        for (int i = 0; i < samples; i++)
+        {
+            median_window_push(&w, in[i], in[i] >= 0);
+
+            int first = i + 1 >= n ? i + 1 - n : 0, count = 0;
+            for (int j = first; j <= i; j++)
+                if (in[j] >= 0)
+                    valid[count++] = in[j];
+
+            float got;
+            bool have = median_window_get(&w, &got);
+            if (have != (count > 0) || (have && got != median_filter(valid, count)))
+                mismatch++;
+
+            if (i + 1 >= n)
+            {
+                memcpy(v, &in[first], n * sizeof(float));
+                if (count > 0 && median_filter(v, n) != valid[count / 2])
+                    old_gap++;
+            }
+        }
+
+        // Cost: the old path copied and sorted the window at every sample
+        double t0 = now_s();
+        for (int i = n; i < samples; i++)
+        {
+            memcpy(v, &in[i - n], n * sizeof(float));
+            sink += median_filter(v, n);
+        }
+        double t_old = (now_s() - t0) / (samples - n);
+
+        t0 = now_s();
+        median_window_init(&w, n);
+        for (int i = 0; i < samples; i++)
+        {
+            float m;
+            median_window_push(&w, in[i], in[i] >= 0);
+            if (median_window_get(&w, &m))
+                sink += m;
+        }
+        double t_new = (now_s() - t0) / samples;
+
+        printf("%6d %10d %10d %12.1f %12.1f %7.1fx\n", n, mismatch, old_gap, t_old * 1e9, t_new * 1e9,
+               t_old / t_new);
+    }
+
+    free(in);
+    return 0;
+}
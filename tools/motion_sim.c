@@ -0,0 +1,620 @@
+/*
+ * Host bench for the motion state machine: replays random HMI command
+ * streams against main/motionControl.c with a simulated column, using the
+ * motor_task loop structure (commands handled on arrival, ticks every
+ * MOTION_TICK_MS, endpoint captures blocking the task). Reports the worst
+ * and mean command-to-actuation latency per command, and checks that a STOP
+ * or a new target takes over the output straight away. Jogs are released by
+ * a model of the jog watchdog, which cuts the output at its deadline
+ * whatever the task is busy with. The state machine reads the column
+ * through the firmware's height filter (main/heightFilter.c) at the moving
+ * sample rate, with sensor noise (-n), as position_sim does. With -j,
+ * obstructions appear at random heights; reported are how many the column
+ * ran into, how many of those the stall detector caught and how fast, and
+ * any stalls flagged on a free column. Jog keys pressed during a
+ * calibration must be refused without arming the watchdog under it. Finally,
+ * calibrations from random heights are timed without stored endpoints, with
+ * stored ones the first switch confirms and with drifted ones, along with
+ * the fastest switch hit (column speed at the end stop) and the motion model
+ * they measured, and the goto ETA is checked against the real move time.
+ *
+ * Build:
+ *   gcc -O2 -Wall -Imain -o motion_sim tools/motion_sim.c main/motionControl.c \
+ *       main/positionControl.c main/stallDetect.c main/motionModel.c \
+ *       main/heightFilter.c main/medianFilter.c main/heightEstimator.c \
+ *       main/sensorHealth.c main/irCurve.c -lm
+ *
+ * Usage: motion_sim [-m minutes] [-c capture_ms] [-w tick_work_us] [-j jams_per_hour] [-n noise] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "motionControl.h"
+#include "heightFilter.h"
+
+#define BOTTOM_MM      4.0f     // switch positions of the simulated column
+#define TOP_MM         18.0f
+#define SPEED          0.65f    // DIST_SPEED_UP/DOWN
+#define TAU_S          0.15f
+#define STEP_US        1000     // plant integration step
+#define JAM_PUSH_DUTY  300      // below this a window expects too little travel to judge
+
+// Must match dist.h, moving profile
+#define RATE_HZ        5000
+#define FRAME          50
+#define WINDOW         25
+
+enum { CMD_JOG_UP, CMD_JOG_DOWN, CMD_STOP, CMD_GOTO, CMD_CALIBRATE, CMD_COUNT };
+static const char *cmd_names[CMD_COUNT] = {"jog up", "jog down", "stop", "goto", "calibrate"};
+
+typedef struct {
+    double worst_us, sum_us;
+    int count, refused, failed;
+} latency_t;
+
+static int64_t capture_us = 130000;   // dist_cal_capture_endpoint() with the idle profile
+static int64_t tick_work_us = 300;    // sensor snapshot + controller step
+
+static float pos = 10.0f, vel = 0;
+static float noise = 0.08f;           // sensor noise std dev, height units
+static height_filter_t sensor;        // what the state machine sees of the column
+static float sensed = 10.0f;          // filtered height, updated every frame
+static int frame_fill;                // samples in the current frame
+static int duty = 0;                  // signed, + is up
+static motion_t motion;
+static motion_model_t model = MOTION_MODEL_DEFAULT;
+static float cal_bottom, cal_top;
+static float impact;                  // fastest end stop hit since last cleared
+static float limit_bottom = -1, limit_top = -1; // stored endpoints, -1 before the first calibration
+
+// Obstruction: blocks travel past jam_pos in jam_dir once armed
+static float jam_pos;
+static int jam_dir;
+static int64_t jam_hit_us = -1, jam_since_us;
+static bool jam_pushed;               // the column has run into the current obstruction
+static int64_t jam_push_max;          // longest push into it so far
+static int64_t sim_now;
+static int stalls, stalls_timed, false_stalls, jams_pushed, missed_long;
+
+// Jog watchdog, MOTOR_WDT_JOG_*_MS
+#define WDT_JOG_US     500000
+static int64_t wdt_deadline = -1;
+static bool wdt_fired;
+static int wdt_cuts;
+static double stall_worst_us, stall_sum_us;
+
+static float rnd(void)
+{
+    return rand() / (RAND_MAX + 1.0f);
+}
+
+static float gauss(void)
+{
+    float u = (rand() + 1.0f) / (RAND_MAX + 2.0f), v = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+    return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * v);
+}
+
+// Inverse of the factory curve, distance back to an ADC code
+static uint16_t distance_to_raw(float d)
+{
+    float v = powf((d + IR_CURVE_OFFSET) / IR_CURVE_A, 1.0f / IR_CURVE_B);
+    float raw = v / IR_VREF * IR_ADC_MAX;
+    return raw < 0 ? 0 : raw > IR_ADC_MAX ? IR_ADC_MAX : (uint16_t)raw;
+}
+
+// Column placed somewhere new at rest: the filter starts over and settles
+static void place(float at)
+{
+    pos = at;
+    vel = 0;
+    height_filter_init(&sensor, WINDOW, RATE_HZ);
+    for (int i = 0; i < 10; i++)
+    {
+        for (int k = 0; k < FRAME; k++)
+            height_filter_sample(&sensor, distance_to_raw(pos + noise * gauss()));
+        height_filter_frame(&sensor, 0, (float)FRAME / RATE_HZ, &sensed);
+    }
+    frame_fill = 0;
+}
+
+// handle_command(): only a jog the state machine took arms the watchdog
+static void kick_watchdog(const motion_output_t *out, int64_t now)
+{
+    bool jog = out->drive == MOTION_DRIVE_UP || out->drive == MOTION_DRIVE_DOWN;
+
+    wdt_deadline = jog ? now + WDT_JOG_US : -1;
+}
+
+static void plant_run(int64_t us)
+{
+    for (int64_t t = 0; t < us; t += STEP_US)
+    {
+        float target = duty / 1023.0f * SPEED;
+
+        vel += (target - vel) * (STEP_US / 1e6f) / TAU_S;
+        pos += vel * STEP_US / 1e6f;
+        if (jam_dir && (pos - jam_pos) * jam_dir > 0)
+        {
+            pos = jam_pos;
+            vel = 0;
+        }
+        // Detection delay counts from when the drive starts pushing into it
+        if (jam_dir && fabsf(pos - jam_pos) < 0.001f && duty * jam_dir >= JAM_PUSH_DUTY)
+        {
+            if (jam_hit_us < 0)
+                jam_hit_us = sim_now + t;
+            if (!jam_pushed)
+                jams_pushed++;
+            jam_pushed = true;
+            if (sim_now + t - jam_hit_us > jam_push_max)
+                jam_push_max = sim_now + t - jam_hit_us;
+        }
+        else
+            jam_hit_us = -1;
+        if (pos < BOTTOM_MM)
+        {
+            pos = BOTTOM_MM;
+            impact = fmaxf(impact, -vel);
+            vel = 0;
+        }
+        if (pos > TOP_MM)
+        {
+            pos = TOP_MM;
+            impact = fmaxf(impact, vel);
+            vel = 0;
+        }
+
+        // The ADC samples at RATE_HZ, the filter runs once per frame
+        for (int k = 0; k < RATE_HZ / 1000 * STEP_US / 1000; k++)
+        {
+            height_filter_sample(&sensor, distance_to_raw(pos + noise * gauss()));
+            if (++frame_fill == FRAME)
+            {
+                frame_fill = 0;
+                height_filter_frame(&sensor, duty / 1023.0f * SPEED, (float)FRAME / RATE_HZ, &sensed);
+            }
+        }
+    }
+}
+
+static motion_input_t input(float dt)
+{
+    motion_input_t in = {
+        .height = sensed, .velocity = sensor.estimator.velocity, .commanded_velocity = duty / 1023.0f * SPEED, .trusted = true,
+        .at_top = pos >= TOP_MM - 0.01f, .at_bottom = pos <= BOTTOM_MM + 0.01f,
+        .locked = false, .limit_bottom = limit_bottom, .limit_top = limit_top, .dt = dt};
+    return in;
+}
+
+// What motor_task does with an output; returns the time it kept the task busy
+static int64_t apply(const motion_output_t *out)
+{
+    int64_t busy = 0;
+
+    switch (out->drive)
+    {
+    case MOTION_DRIVE_UP:
+        duty = 1023;
+        break;
+    case MOTION_DRIVE_DOWN:
+        duty = -1023;
+        break;
+    case MOTION_DRIVE_DUTY:
+        duty = out->duty;
+        break;
+    case MOTION_DRIVE_SOFT_STOP:
+    case MOTION_DRIVE_STOP:
+        duty = 0;
+        break;
+    default:
+        break;
+    }
+
+    if (out->events & MOTION_EV_STALL)
+    {
+        if (!jam_dir || fabsf(pos - jam_pos) > 0.001f)
+            false_stalls++;
+        else
+        {
+            stalls++;
+            // Not timed when caught while pushing too softly
+            if (jam_hit_us >= 0)
+            {
+                double us = (double)(sim_now - jam_hit_us);
+                stalls_timed++;
+                stall_sum_us += us;
+                if (us > stall_worst_us)
+                    stall_worst_us = us;
+            }
+        }
+        jam_dir = 0;
+        jam_hit_us = -1;
+        jam_pushed = false;
+        jam_push_max = 0;
+    }
+    if (out->events & MOTION_EV_CAL_BOTTOM)
+    {
+        busy += capture_us;
+        cal_bottom = pos;
+    }
+    if (out->events & MOTION_EV_CAL_TOP)
+    {
+        busy += capture_us;
+        cal_top = pos;
+    }
+    if (motion.state == MOTION_CAL_WAIT_CENTER)
+    {
+        motion_input_t in = input(0);
+        motion_output_t next;
+
+        limit_bottom = cal_bottom;
+        limit_top = cal_top;
+        next = motion_cal_center(&motion, (cal_bottom + cal_top) / 2, &in);
+        busy += apply(&next);
+    }
+    return busy;
+}
+
+// Did the output react the way the command asks for?
+static bool took_over(int cmd, const motion_output_t *out, float target)
+{
+    switch (cmd)
+    {
+    case CMD_STOP:
+        return out->drive == MOTION_DRIVE_SOFT_STOP || out->drive == MOTION_DRIVE_STOP;
+    case CMD_GOTO:
+        // already inside the arrival window is a move with nothing to do
+        return out->drive == MOTION_DRIVE_DUTY &&
+               (fabsf(target - pos) < motion.cfg->tolerance || (out->duty > 0) == (target > pos));
+    default:
+        return true;
+    }
+}
+
+// One calibration from `from`, ticking every period until the state machine
+// is idle again. Stored endpoints are off by `drift`, random sign, -1 for
+// none stored. Returns the time it took, or -1 if it did not finish.
+static double calibrate_once(float from, float drift)
+{
+    const int64_t period = MOTION_TICK_MS * 1000;
+    int64_t t = 0;
+
+    place(from);
+    duty = 0;
+    impact = 0;
+    jam_dir = 0;
+    limit_bottom = drift >= 0 ? BOTTOM_MM + (rnd() < 0.5f ? -drift : drift) : -1;
+    limit_top = drift >= 0 ? TOP_MM + (rnd() < 0.5f ? -drift : drift) : -1;
+    cal_bottom = limit_bottom; // motor_task keeps an end the calibration skips
+    cal_top = limit_top;
+
+    motion_input_t in = input(0);
+    motion_output_t out = motion_request(&motion, MOTION_REQ_CALIBRATE, 0, &in);
+    int64_t busy = apply(&out);
+
+    while (motion_busy(&motion) && t < 300000000)
+    {
+        int64_t step = period + busy;
+
+        sim_now = t;
+        plant_run(step);
+        t += step;
+        in = input(step / 1e6f);
+        out = motion_tick(&motion, &in);
+        busy = apply(&out);
+        if (out.events & MOTION_EV_STALL)
+            return -1;
+    }
+    return motion_busy(&motion) ? -1 : t / 1e6;
+}
+
+// Calibrations with jog keys tapped at random while they run. Each tap is
+// refused; the watchdog it must not arm would cut the drive and stop the
+// calibration, as motor_task does when notified.
+static void calibration_jog_bench(int runs)
+{
+    const int64_t period = MOTION_TICK_MS * 1000;
+    int taps = 0, broken = 0;
+
+    for (int i = 0; i < runs; i++)
+    {
+        int64_t t = 0, busy;
+
+        place(BOTTOM_MM + 0.5f + rnd() * (TOP_MM - BOTTOM_MM - 1.0f));
+        duty = 0;
+        jam_dir = 0;
+        wdt_deadline = -1;
+        limit_bottom = BOTTOM_MM + (rnd() - 0.5f) * 0.3f;
+        limit_top = TOP_MM + (rnd() - 0.5f) * 0.3f;
+
+        motion_input_t in = input(0);
+        motion_output_t out = motion_request(&motion, MOTION_REQ_CALIBRATE, 0, &in);
+        busy = apply(&out);
+
+        while (motion_busy(&motion) && t < 300000000)
+        {
+            int64_t step = period + busy;
+
+            sim_now = t;
+            plant_run(step);
+            t += step;
+            busy = 0;
+
+            if (wdt_deadline >= 0 && t >= wdt_deadline)
+            {
+                wdt_deadline = -1;
+                if (duty)
+                {
+                    duty = 0;
+                    in = input(0);
+                    out = motion_request(&motion, MOTION_REQ_STOP, 0, &in);
+                    busy += apply(&out);
+                }
+            }
+            if (rnd() < period / 2e6) // a tap every two seconds or so
+            {
+                in = input(0);
+                out = motion_request(&motion, rnd() < 0.5f ? MOTION_REQ_JOG_UP : MOTION_REQ_JOG_DOWN, 0, &in);
+                kick_watchdog(&out, t);
+                busy += apply(&out);
+                taps++;
+            }
+            in = input(step / 1e6f);
+            out = motion_tick(&motion, &in);
+            busy += apply(&out);
+        }
+        if (motion_busy(&motion) || fabsf(pos - (BOTTOM_MM + TOP_MM) / 2) > 0.2f)
+            broken++;
+    }
+    wdt_deadline = -1;
+    printf("jog keys during calibration: %d taps over %d runs, calibrations broken %d\n", taps, runs, broken);
+}
+
+static void calibration_bench(int runs)
+{
+    // None stored, stored and still right (under MOTION_CAL_AGREE), stored
+    // and drifted past it
+    static const float drifts[] = {-1, 0.03f, 0.2f};
+    static const char *names[] = {"full sweep", "stored, agree", "stored, drift"};
+
+    printf("\n%-14s %6s %8s %8s %10s %8s\n", "calibration", "runs", "mean_s", "worst_s", "hit_speed", "failed");
+    for (int k = 0; k < 3; k++)
+    {
+        double sum = 0, worst = 0;
+        float hit = 0;
+        int done = 0, failed = 0;
+
+        for (int i = 0; i < runs; i++)
+        {
+            double s = calibrate_once(BOTTOM_MM + 0.5f + rnd() * (TOP_MM - BOTTOM_MM - 1.0f), drifts[k]);
+
+            if (s < 0 || fabsf(pos - (BOTTOM_MM + TOP_MM) / 2) > 0.2f)
+            {
+                failed++;
+                continue;
+            }
+            done++;
+            sum += s;
+            if (s > worst)
+                worst = s;
+            hit = fmaxf(hit, impact);
+        }
+        printf("%-14s %6d %8.1f %8.1f %10.3f %8d\n", names[k], runs,
+               done ? sum / done : 0, worst, hit, failed);
+    }
+    printf("model: up %.3f/s coast %.3f, down %.3f/s coast %.3f, start %.2f s (plant %.3f/s coast %.3f)\n",
+           model.speed[MOTION_MODEL_UP], model.coast[MOTION_MODEL_UP], model.speed[MOTION_MODEL_DOWN],
+           model.coast[MOTION_MODEL_DOWN], model.start_s, SPEED, SPEED * TAU_S);
+}
+
+// ETA shown when a goto starts against the time the move really took
+static void eta_bench(int runs)
+{
+    const int64_t period = MOTION_TICK_MS * 1000;
+    double worst = 0, sum = 0;
+
+    for (int i = 0; i < runs; i++)
+    {
+        place(BOTTOM_MM + 0.5f + rnd() * (TOP_MM - BOTTOM_MM - 1.0f));
+        duty = 0;
+        jam_dir = 0;
+
+        float target = BOTTOM_MM + 0.5f + rnd() * (TOP_MM - BOTTOM_MM - 1.0f);
+        motion_input_t in = input(0);
+        motion_output_t out = motion_request(&motion, MOTION_REQ_GOTO, target, &in);
+        float eta = motion_eta(&motion);
+        int64_t t = 0;
+
+        apply(&out);
+        while (motion_busy(&motion) && t < 60000000)
+        {
+            plant_run(period);
+            t += period;
+            in = input(period / 1e6f);
+            out = motion_tick(&motion, &in);
+            apply(&out);
+        }
+
+        double err = fabs(eta - t / 1e6);
+        sum += err;
+        if (err > worst)
+            worst = err;
+    }
+    printf("goto ETA error over %d moves: mean %.2f s, worst %.2f s\n", runs, sum / runs, worst);
+}
+
+int main(int argc, char **argv)
+{
+    static const position_cfg_t cfg = POSITION_CFG_DEFAULT;
+    static const stall_cfg_t stall_cfg = STALL_CFG_DEFAULT;
+    latency_t lat[CMD_COUNT] = {0};
+    double minutes = 30, jams_per_hour = 0;
+    int jams = 0;
+    int opt, seed = 1;
+
+    while ((opt = getopt(argc, argv, "m:c:w:j:n:s:")) != -1)
+    {
+        if (opt == 'm')
+            minutes = atof(optarg);
+        else if (opt == 'c')
+            capture_us = atoi(optarg) * 1000LL;
+        else if (opt == 'w')
+            tick_work_us = atoi(optarg);
+        else if (opt == 'j')
+            jams_per_hour = atof(optarg);
+        else if (opt == 'n')
+            noise = atof(optarg);
+        else if (opt == 's')
+            seed = atoi(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-m minutes] [-c capture_ms] [-w tick_work_us] [-j jams_per_hour] [-n noise] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+    ir_curve_init();
+    motion_init(&motion, &cfg, &stall_cfg, &model);
+    place(pos);
+
+    const int64_t period = MOTION_TICK_MS * 1000;
+    const int64_t end = (int64_t)(minutes * 60e6);
+    int64_t now = 0, next_tick = period, busy_until = 0, last_tick = 0;
+    int64_t next_cmd = 200000;
+    int cmd_left = 0, cmd = CMD_STOP;
+
+    while (now < end)
+    {
+        // Next event: a tick or a command, whichever is due first
+        int64_t t = next_cmd < next_tick ? next_cmd : next_tick;
+        if (t < busy_until)
+            t = busy_until;
+
+        // The watchdog callback runs on time even while the task is busy
+        if (wdt_deadline >= 0 && wdt_deadline <= t)
+        {
+            sim_now = now;
+            plant_run(wdt_deadline - now);
+            now = wdt_deadline;
+            wdt_deadline = -1;
+            if (duty)
+            {
+                duty = 0;
+                wdt_fired = true;
+                wdt_cuts++;
+            }
+        }
+
+        sim_now = now;
+        plant_run(t - now);
+        now = t;
+        sim_now = now;
+
+        // An obstruction nobody runs into for a while goes away
+        if (jam_dir && jam_hit_us < 0 && now - jam_since_us > 20000000)
+        {
+            // Two stall windows cover any start of the push
+            if (jam_push_max >= 2 * stall_cfg.window_s * 1e6)
+                missed_long++;
+            jam_dir = 0;
+            jam_hit_us = -1;
+            jam_pushed = false;
+            jam_push_max = 0;
+        }
+
+        if (now >= next_cmd)
+        {
+            // Task woke on the queue; it only gets here once it is free
+            int64_t arrival = next_cmd;
+            float target = BOTTOM_MM + 0.5f + rnd() * (TOP_MM - BOTTOM_MM - 1.0f);
+
+            motion_input_t in = input(0);
+            motion_req_t req = cmd == CMD_JOG_UP ? MOTION_REQ_JOG_UP : cmd == CMD_JOG_DOWN ? MOTION_REQ_JOG_DOWN
+                               : cmd == CMD_STOP ? MOTION_REQ_STOP : cmd == CMD_GOTO ? MOTION_REQ_GOTO
+                                                                                     : MOTION_REQ_CALIBRATE;
+            motion_output_t out = motion_request(&motion, req, target, &in);
+            kick_watchdog(&out, now);
+            busy_until = now + apply(&out);
+
+            latency_t *l = &lat[cmd];
+            double us = (double)(now - arrival);
+            if (out.events & MOTION_EV_REFUSED)
+                l->refused++;
+            else
+            {
+                l->count++;
+                l->sum_us += us;
+                if (us > l->worst_us)
+                    l->worst_us = us;
+                if (!took_over(cmd, &out, target))
+                    l->failed++;
+            }
+
+            // Jogs come as a stream of repeats while the button is held
+            if (cmd_left > 0)
+            {
+                cmd_left--;
+                next_cmd = now + 100000;
+            }
+            else
+            {
+                double r = rnd();
+                cmd = r < 0.25 ? CMD_JOG_UP : r < 0.5 ? CMD_JOG_DOWN : r < 0.75 ? CMD_STOP : r < 0.98 ? CMD_GOTO
+                                                                                                      : CMD_CALIBRATE;
+                cmd_left = (cmd == CMD_JOG_UP || cmd == CMD_JOG_DOWN) ? rand() % 30 : 0;
+                next_cmd = now + 50000 + (int64_t)(rnd() * 4e6);
+            }
+            continue;
+        }
+
+        if (now >= next_tick)
+        {
+            if (!jam_dir && rnd() < jams_per_hour * period / 3.6e9)
+            {
+                jam_dir = rnd() < 0.5f ? 1 : -1;
+                jam_pos = pos + jam_dir * (0.2f + rnd() * 3.0f);
+                jam_since_us = now;
+                jams++;
+            }
+            motion_input_t in = input((now - last_tick) / 1e6f);
+            int64_t busy = 0;
+
+            // Notified by the watchdog: bring the state machine to a stop
+            if (wdt_fired)
+            {
+                motion_input_t now_in = input(0);
+                motion_output_t stop = motion_request(&motion, MOTION_REQ_STOP, 0, &now_in);
+                busy += apply(&stop);
+                wdt_fired = false;
+            }
+
+            motion_output_t out = motion_tick(&motion, &in);
+
+            last_tick = now;
+            busy_until = now + tick_work_us + busy + apply(&out);
+            next_tick += period;
+            if (next_tick <= now)
+                next_tick = now + period;
+        }
+    }
+
+    printf("%.0f simulated minutes, tick %d ms, capture %lld ms, tick work %lld us\n\n",
+           minutes, MOTION_TICK_MS, (long long)(capture_us / 1000), (long long)tick_work_us);
+    printf("%-10s %8s %8s %10s %10s %9s\n", "command", "handled", "refused", "worst_ms", "mean_ms", "no_take");
+    for (int c = 0; c < CMD_COUNT; c++)
+        printf("%-10s %8d %8d %10.2f %10.3f %9d\n", cmd_names[c], lat[c].count, lat[c].refused,
+               lat[c].worst_us / 1000, lat[c].count ? lat[c].sum_us / lat[c].count / 1000 : 0, lat[c].failed);
+    printf("\njog watchdog cuts %d\n", wdt_cuts);
+    printf("obstructions %d, run into %d, caught %d (%.0f %%, worst %.0f ms, mean %.0f ms), false stalls %d\n", jams,
+           jams_pushed, stalls, jams_pushed ? 100.0 * stalls / jams_pushed : 0, stall_worst_us / 1000,
+           stalls_timed ? stall_sum_us / stalls_timed / 1000 : 0, false_stalls);
+    printf("missed %d, %d of them pushed into for two stall windows or longer\n", jams_pushed - stalls, missed_long);
+
+    calibration_bench(200);
+    calibration_jog_bench(100);
+    eta_bench(200);
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * Host bench for the position controller: a simulated column (first order
+ * motor lag, dead time, stiction, sensor noise) read through the firmware
+ * filter chain, driven by main/positionControl.c and by the old full-duty
+ * bang-bang move for comparison. Each move runs several times with fresh
+ * sensor noise; prints the mean settle time, overshoot and final error.
+ *
+ * Build:
+ *   gcc -O2 -Wall -Imain -o position_sim tools/position_sim.c main/positionControl.c \
+ *       main/heightFilter.c main/medianFilter.c main/heightEstimator.c \
+ *       main/sensorHealth.c main/irCurve.c -lm
+ *
+ * Usage: position_sim [-n noise] [-s stiction_duty] [-d dead_ms] [-t tau_s] [-r runs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "heightFilter.h"
+#include "positionControl.h"
+
+// Must match dist.h
+#define RATE_HZ        5000
+#define FRAME          50
+#define WINDOW         25
+
+#define TICK_S         ((float)FRAME / RATE_HZ)
+#define MAX_MOVE_S     60.0f
+#define HOLD_S         1.0f     // simulated time kept after the move ends
+#define SETTLE_WINDOW  0.05f    // settle time is taken against this, whatever the arrival window
+
+typedef struct {
+    float noise;        // sensor noise std dev, height units
+    int stiction;       // duty below which the column does not move
+    float dead_s;       // driver + gearbox dead time
+    float tau;          // motor time constant
+} plant_cfg_t;
+
+typedef struct {
+    float pos, vel;
+    int duty_q[64];     // duty delayed by the dead time
+    int q_len, q_pos;
+} plant_t;
+
+static plant_cfg_t plant_cfg = {.noise = 0.08f, .stiction = 150, .dead_s = 0.02f, .tau = 0.15f};
+
+static float gauss(void)
+{
+    float u = (rand() + 1.0f) / (RAND_MAX + 2.0f), v = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+    return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * v);
+}
+
+// Inverse of the factory curve, distance back to an ADC code
+static uint16_t distance_to_raw(float d)
+{
+    float v = powf((d + IR_CURVE_OFFSET) / IR_CURVE_A, 1.0f / IR_CURVE_B);
+    float raw = v / IR_VREF * IR_ADC_MAX;
+    return raw < 0 ? 0 : raw > IR_ADC_MAX ? IR_ADC_MAX : (uint16_t)raw;
+}
+
+static void plant_init(plant_t *p, float pos)
+{
+    memset(p, 0, sizeof(*p));
+    p->pos = pos;
+    p->q_len = (int)(plant_cfg.dead_s / TICK_S + 0.5f);
+}
+
+// Advance one control tick, feeding the filter at the ADC rate
+static void plant_tick(plant_t *p, int duty, height_filter_t *f)
+{
+    int applied = duty;
+
+    if (p->q_len > 0)
+    {
+        applied = p->duty_q[p->q_pos];
+        p->duty_q[p->q_pos] = duty;
+        p->q_pos = (p->q_pos + 1) % p->q_len;
+    }
+
+    float v_target = abs(applied) < plant_cfg.stiction ? 0 : applied / 1023.0f * DIST_SPEED_UP;
+    float dt = 1.0f / RATE_HZ;
+
+    for (int i = 0; i < FRAME; i++)
+    {
+        p->vel += (v_target - p->vel) * dt / plant_cfg.tau;
+        p->pos += p->vel * dt;
+        height_filter_sample(f, distance_to_raw(p->pos + plant_cfg.noise * gauss()));
+    }
+}
+
+typedef struct {
+    float settle_s;     // move start until the column stays inside the window
+    float overshoot;    // furthest past the target, in the direction of travel
+    float error;        // distance from the target once everything stopped
+} move_result_t;
+
+typedef int (*controller_fn)(void *ctx, float height, float velocity);
+
+static int bang_bang(void *ctx, float height, float velocity)
+{
+    float target = *(float *)ctx;
+
+    // move_to_position() before the controller: full duty, cut within 0.1
+    if (fabsf(height - target) < 0.1f)
+        return 0;
+    return height < target ? 1023 : -1023;
+}
+
+typedef struct {
+    position_ctrl_t ctrl;
+} pid_ctx_t;
+
+static int pid(void *ctx, float height, float velocity)
+{
+    return position_ctrl_step(&((pid_ctx_t *)ctx)->ctrl, height, velocity, TICK_S);
+}
+
+static move_result_t run_move(float from, float to, float tolerance, bool use_pid, const position_cfg_t *cfg)
+{
+    plant_t p;
+    height_filter_t f;
+    pid_ctx_t pid_ctx;
+    float target = to;
+    float sign = to >= from ? 1 : -1;
+    float h = from, t = 0, stopped_at = -1, last_outside = 0;
+    int duty = 0;
+    move_result_t r = {0};
+
+    plant_init(&p, from);
+    height_filter_init(&f, WINDOW, RATE_HZ);
+    for (int i = 0; i < 10; i++)
+    {
+        plant_tick(&p, 0, &f);
+        height_filter_frame(&f, 0, TICK_S, &h);
+    }
+    if (use_pid)
+        position_ctrl_start(&pid_ctx.ctrl, cfg, h, 0, to);
+
+    while (t < MAX_MOVE_S && (stopped_at < 0 || t < stopped_at + HOLD_S))
+    {
+        if (stopped_at < 0)
+        {
+            duty = use_pid ? pid(&pid_ctx, h, f.estimator.velocity) : bang_bang(&target, h, 0);
+            // Both end with the motor off, the old loop on its first cut
+            if (use_pid ? position_ctrl_done(&pid_ctx.ctrl) : duty == 0)
+            {
+                duty = 0;
+                stopped_at = t;
+            }
+        }
+
+        plant_tick(&p, duty, &f);
+        height_filter_frame(&f, duty / 1023.0f * DIST_SPEED_UP, TICK_S, &h);
+        t += TICK_S;
+
+        float past = (p.pos - to) * sign;
+        if (past > r.overshoot)
+            r.overshoot = past;
+        if (fabsf(p.pos - to) >= tolerance)
+            last_outside = t;
+    }
+
+    r.settle_s = stopped_at < 0 ? NAN : last_outside;
+    r.error = fabsf(p.pos - to);
+    return r;
+}
+
+// Mean of runs of one move with fresh noise each, NaN settle if any never finished
+static move_result_t run_moves(float from, float to, bool use_pid, const position_cfg_t *cfg, int runs)
+{
+    move_result_t sum = {0};
+
+    for (int k = 0; k < runs; k++)
+    {
+        move_result_t r = run_move(from, to, SETTLE_WINDOW, use_pid, cfg);
+
+        sum.settle_s += r.settle_s / runs;
+        sum.overshoot += r.overshoot / runs;
+        sum.error += r.error / runs;
+    }
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    static const position_cfg_t cfg = POSITION_CFG_DEFAULT;
+    static const float moves[][2] = {
+        {8.0f, 8.3f}, {8.0f, 7.7f}, {6.0f, 8.0f}, {10.0f, 8.0f},
+        {5.0f, 12.0f}, {14.0f, 6.0f}, {4.0f, 18.0f}, {18.0f, 4.0f}};
+    int opt, runs = 20;
+
+    while ((opt = getopt(argc, argv, "n:s:d:t:r:")) != -1)
+    {
+        if (opt == 'n')
+            plant_cfg.noise = atof(optarg);
+        else if (opt == 's')
+            plant_cfg.stiction = atoi(optarg);
+        else if (opt == 'd')
+            plant_cfg.dead_s = atof(optarg) / 1000.0f;
+        else if (opt == 't')
+            plant_cfg.tau = atof(optarg);
+        else if (opt == 'r')
+            runs = atoi(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-n noise] [-s stiction_duty] [-d dead_ms] [-t tau_s] [-r runs]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (runs < 1)
+        runs = 1;
+
+    ir_curve_init();
+    srand(1);
+
+    printf("arrival +-%.3f, settle taken at +-%.2f, noise %.2f, stiction %d, dead time %.0f ms, tau %.2f s\n",
+           cfg.tolerance, SETTLE_WINDOW, plant_cfg.noise, plant_cfg.stiction, plant_cfg.dead_s * 1000, plant_cfg.tau);
+    printf("mean of %d runs per move\n\n", runs);
+    printf("%-14s | %21s | %21s\n", "", "bang-bang", "controller");
+    printf("%-14s | %6s %7s %6s | %6s %7s %6s\n", "move", "settle", "oversh", "error", "settle", "oversh", "error");
+
+    for (size_t i = 0; i < sizeof(moves) / sizeof(moves[0]); i++)
+    {
+        move_result_t a = run_moves(moves[i][0], moves[i][1], false, &cfg, runs);
+        move_result_t b = run_moves(moves[i][0], moves[i][1], true, &cfg, runs);
+
+        printf("%5.1f -> %5.1f | %6.2f %7.3f %6.3f | %6.2f %7.3f %6.3f\n", moves[i][0], moves[i][1],
+               a.settle_s, a.overshoot, a.error, b.settle_s, b.overshoot, b.error);
+    }
+    return 0;
+}
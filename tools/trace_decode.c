@@ -0,0 +1,168 @@
+/*
+ * Decode TRC1 trace images to CSV: motion tick traces (type 2) captured with
+ * the 0xDD PC command, and raw ADC traces (type 1). The image is searched for
+ * in the capture, so console text around it does no harm.
+ *
+ * Build:
+ *   gcc -O2 -Wall -Imain -o trace_decode tools/trace_decode.c
+ *
+ * Capture: stty -F /dev/ttyUSB0 115200 raw; cat /dev/ttyUSB0 > cap.bin, send
+ * DD 06 E3 for the motion ring (DD 05 E2 for the image saved in flash after
+ * DD 07 E4), stop cat once it replies.
+ *
+ * Usage: trace_decode [-o out.csv] cap.bin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "adcTrace.h"
+#include "motionTrace.h"
+#include "motionControl.h"
+#include "traceDump.h"
+
+static const char *state_names[] = {
+    [MOTION_IDLE] = "idle",
+    [MOTION_JOG_UP] = "jog_up",
+    [MOTION_JOG_DOWN] = "jog_down",
+    [MOTION_GOTO] = "goto",
+    [MOTION_BACKOFF] = "backoff",
+    [MOTION_CAL_SEEK] = "cal_seek",
+    [MOTION_CAL_COAST] = "cal_coast",
+    [MOTION_CAL_SWEEP] = "cal_sweep",
+    [MOTION_CAL_WAIT_CENTER] = "cal_wait_center",
+    [MOTION_CAL_CENTER] = "cal_center",
+};
+
+// motor_cmd_t order, motorControl.h needs the IDF headers
+static const char *cmd_names[] = {"up", "down", "stop", "goto", "save", "calibrate"};
+
+#define NAMES(a) (sizeof(a) / sizeof(a[0]))
+
+static void decode_motion(FILE *out, const motion_trace_rec_t *r, uint32_t n)
+{
+    fprintf(out, "t_s,height,target,velocity,duty,state,dir,running,stopping,at_top,at_bottom,"
+                 "trusted,locked,events,cmd\n");
+    for (uint32_t i = 0; i < n; i++, r++)
+    {
+        double t = (uint32_t)(r->timestamp_us - (r - i)->timestamp_us) / 1e6;
+
+        fprintf(out, "%.4f,%.3f,", t, r->height / (double)MOTION_TRACE_SCALE);
+        if (r->target == MOTION_TRACE_NONE)
+            fprintf(out, ",");
+        else
+            fprintf(out, "%.3f,", r->target / (double)MOTION_TRACE_SCALE);
+        fprintf(out, "%.3f,%d,%s,%d,%d,%d,%d,%d,%d,%d,0x%02x,%s\n",
+                r->velocity / (double)MOTION_TRACE_SCALE, r->duty,
+                r->state < NAMES(state_names) && state_names[r->state] ? state_names[r->state] : "?",
+                r->flags & MOTION_TRACE_DIR_MASK,
+                !!(r->flags & MOTION_TRACE_RUNNING), !!(r->flags & MOTION_TRACE_STOPPING),
+                !!(r->flags & MOTION_TRACE_AT_TOP), !!(r->flags & MOTION_TRACE_AT_BOTTOM),
+                !!(r->flags & MOTION_TRACE_TRUSTED), !!(r->flags & MOTION_TRACE_LOCKED), r->events,
+                r->cmd == MOTION_TRACE_NO_CMD ? ""
+                : r->cmd < NAMES(cmd_names) && cmd_names[r->cmd] ? cmd_names[r->cmd]
+                                                                  : "?");
+    }
+}
+
+static void decode_adc(FILE *out, const adc_trace_rec_t *r, uint32_t n)
+{
+    fprintf(out, "t_s,raw,dir,running,moving,frame_end,duty\n");
+    for (uint32_t i = 0; i < n; i++, r++)
+    {
+        double t = (uint32_t)(r->timestamp_us - (r - i)->timestamp_us) / 1e6;
+
+        fprintf(out, "%.6f,%u,%d,%d,%d,%d,%d\n", t, r->raw, r->motor & ADC_TRACE_DIR_MASK,
+                !!(r->motor & ADC_TRACE_RUNNING), !!(r->motor & ADC_TRACE_MOVING),
+                !!(r->motor & ADC_TRACE_FRAME_END), r->duty << 2);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *out_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:")) != -1)
+    {
+        if (opt == 'o')
+            out_path = optarg;
+        else
+            break;
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-o out.csv] cap.bin\n", argv[0]);
+        return 2;
+    }
+
+    const char *path = argv[optind];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(size);
+    if (fread(buf, 1, size, f) != (size_t)size)
+        size = 0;
+    fclose(f);
+
+    for (long pos = 0; pos + (long)sizeof(trace_header_t) < size; pos++)
+    {
+        trace_header_t h;
+
+        if (memcmp(&buf[pos], TRACE_MAGIC, 4) != 0)
+            continue;
+        memcpy(&h, &buf[pos], sizeof(h));
+
+        bool motion = h.type == TRACE_TYPE_MOTION && h.rec_size == sizeof(motion_trace_rec_t);
+        bool adc = h.type == TRACE_TYPE_ADC && h.rec_size == sizeof(adc_trace_rec_t);
+        if (!motion && !adc)
+            continue;
+
+        long end = pos + sizeof(h) + (long)h.count * h.rec_size;
+        if (end >= size)
+            continue;
+
+        uint8_t sum = 0;
+        for (long i = pos; i < end; i++)
+            sum += buf[i];
+        if (sum != buf[end])
+        {
+            fprintf(stderr, "%s: trace at %ld fails its checksum\n", path, pos);
+            continue;
+        }
+
+        FILE *out = out_path ? fopen(out_path, "w") : stdout;
+        if (out == NULL)
+        {
+            perror(out_path);
+            return 1;
+        }
+
+        // Records are packed, copy them out to aligned memory
+        void *recs = malloc(h.count * h.rec_size + 1);
+        memcpy(recs, &buf[pos + sizeof(h)], h.count * h.rec_size);
+        if (motion)
+            decode_motion(out, recs, h.count);
+        else
+            decode_adc(out, recs, h.count);
+
+        fprintf(stderr, "%s: %u %s records\n", path, h.count, motion ? "motion" : "ADC");
+        free(recs);
+        if (out != stdout)
+            fclose(out);
+        free(buf);
+        return 0;
+    }
+
+    fprintf(stderr, "%s: no trace found\n", path);
+    free(buf);
+    return 1;
+}
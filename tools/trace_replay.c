@@ -0,0 +1,514 @@
+/*
+ * Host-side replay bench for raw ADC traces (TRC1, type 1) captured with the
+ * 0xDD PC command. Runs the firmware filter chain from main/ over the trace,
+ * together with the pre-DMA chain and optional candidate settings, and prints
+ * lag, noise, overshoot and processing cost for each.
+ *
+ * Build:
+ *   gcc -O2 -Wall -Imain -o trace_replay tools/trace_replay.c main/heightFilter.c \
+ *       main/medianFilter.c main/heightEstimator.c main/sensorHealth.c main/irCurve.c -lm
+ *
+ * Capture: stty -F /dev/ttyUSB0 115200 raw; cat /dev/ttyUSB0 > cap.bin, send
+ * DD 03 E0 (or DD 05 E2 for the copy saved in flash), stop cat once it replies.
+ *
+ * Usage: trace_replay [-c idle,moving,alpha,beta]... [-o out.csv] cap.bin
+ *   -c   add a candidate: median windows for the two profiles and estimator gains
+ *   -o   write t_s,raw,<chain>... with each chain's latest output per sample
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "heightFilter.h"
+#include "adcTrace.h"
+#include "traceDump.h"
+
+// Must match dist.h
+#define IDLE_RATE_HZ    800
+#define IDLE_WINDOW     63
+#define MOVING_RATE_HZ  5000
+#define MOVING_WINDOW   25
+#define MOTOR_UP        1
+#define MOTOR_DOWN      0
+
+#define MAX_CHAINS      8
+#define REF_HALF_US     20000   // reference is the centred median of +-20 ms of samples
+#define MAX_LAG_MS      400
+#define SETTLE_START_US 300000  // after a stop, the settled height is averaged from here
+#define SETTLE_END_US   800000
+#define REPEATS         20      // timing runs per chain
+
+typedef struct {
+    double t;                   // seconds from the first record
+    float height;
+    bool moving;
+} sample_out_t;
+
+typedef struct chain chain_t;
+struct chain {
+    char name[32];
+    void (*reset)(chain_t *c);
+    // Feed one record, true with *height set when the chain produced an output
+    bool (*feed)(chain_t *c, const adc_trace_rec_t *r, float *height);
+    uint8_t window[2];
+    float alpha, beta;
+    height_filter_t filter;
+    bool moving;
+    uint32_t last_frame_us;
+    bool started;
+    // legacy chain
+    float legacy_buf[11];
+    int legacy_n;
+    uint32_t legacy_next_us;
+    float legacy_smooth;
+    bool legacy_init;
+
+    sample_out_t *out;
+    uint32_t out_count;
+    double ns_per_sample;
+};
+
+static adc_trace_rec_t *recs;
+static uint32_t rec_count;
+
+static float commanded_velocity(const adc_trace_rec_t *r)
+{
+    if (!(r->motor & ADC_TRACE_RUNNING))
+        return 0;
+
+    float duty = (r->duty << 2) / 1023.0f;
+    if ((r->motor & ADC_TRACE_DIR_MASK) == MOTOR_UP)
+        return duty * DIST_SPEED_UP;
+    if ((r->motor & ADC_TRACE_DIR_MASK) == MOTOR_DOWN)
+        return -duty * DIST_SPEED_DOWN;
+    return 0;
+}
+
+/* ---- the firmware chain, frame boundaries and profiles as recorded ---- */
+
+static void firmware_reset(chain_t *c)
+{
+    height_filter_init(&c->filter, c->window[0], IDLE_RATE_HZ);
+    height_estimator_init(&c->filter.estimator, c->alpha, c->beta, DIST_EST_TAU_S);
+    c->moving = false;
+    c->started = false;
+}
+
+static bool firmware_feed(chain_t *c, const adc_trace_rec_t *r, float *height)
+{
+    bool moving = r->motor & ADC_TRACE_MOVING;
+
+    if (moving != c->moving)
+    {
+        c->moving = moving;
+        height_filter_set_window(&c->filter, c->window[moving],
+                                 moving ? MOVING_RATE_HZ : IDLE_RATE_HZ);
+    }
+
+    height_filter_sample(&c->filter, r->raw);
+    if (!(r->motor & ADC_TRACE_FRAME_END))
+        return false;
+
+    float dt = c->started ? (uint32_t)(r->timestamp_us - c->last_frame_us) / 1e6f : 1.0f;
+    c->last_frame_us = r->timestamp_us;
+    c->started = true;
+    return height_filter_frame(&c->filter, commanded_velocity(r), dt, height);
+}
+
+/* ---- the pre-DMA chain: 11 polls 5 ms apart, bubble median, 0.7/0.3 EMA ---- */
+
+static void legacy_reset(chain_t *c)
+{
+    c->legacy_n = 0;
+    c->legacy_next_us = recs[0].timestamp_us;
+    c->legacy_init = false;
+}
+
+static float legacy_median(float *v, int n)
+{
+    for (int i = 0; i < n - 1; i++)
+        for (int j = i + 1; j < n; j++)
+            if (v[j] < v[i])
+            {
+                float tmp = v[i];
+                v[i] = v[j];
+                v[j] = tmp;
+            }
+    return v[n / 2];
+}
+
+static bool legacy_feed(chain_t *c, const adc_trace_rec_t *r, float *height)
+{
+    if ((int32_t)(r->timestamp_us - c->legacy_next_us) < 0)
+        return false;
+
+    float voltage = (r->raw / 4095.0f) * 3.3f;
+    c->legacy_buf[c->legacy_n++] = voltage < 0.1f ? -1 : ir_curve_reference(r->raw);
+    c->legacy_next_us = r->timestamp_us + 5000;
+    if (c->legacy_n < 11)
+        return false;
+
+    // 200 ms task delay after each reading
+    c->legacy_n = 0;
+    c->legacy_next_us += 200000;
+
+    float median = legacy_median(c->legacy_buf, 11);
+    if (!c->legacy_init)
+    {
+        c->legacy_smooth = median;
+        c->legacy_init = true;
+    }
+    else
+        c->legacy_smooth = 0.7f * c->legacy_smooth + 0.3f * median;
+
+    *height = roundf(c->legacy_smooth * 10.0f) / 10.0f;
+    return true;
+}
+
+/* ---- trace loading ---- */
+
+static bool load_trace(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(size);
+    if (fread(buf, 1, size, f) != (size_t)size)
+        size = 0;
+    fclose(f);
+
+    // UART captures carry console text around the image
+    for (long pos = 0; pos + (long)sizeof(trace_header_t) < size; pos++)
+    {
+        trace_header_t h;
+
+        if (memcmp(&buf[pos], TRACE_MAGIC, 4) != 0)
+            continue;
+        memcpy(&h, &buf[pos], sizeof(h));
+        if (h.type != TRACE_TYPE_ADC || h.rec_size != sizeof(adc_trace_rec_t))
+            continue;
+
+        long end = pos + sizeof(h) + (long)h.count * h.rec_size;
+        if (end >= size)
+            continue;
+
+        uint8_t sum = 0;
+        for (long i = pos; i < end; i++)
+            sum += buf[i];
+        if (sum != buf[end])
+        {
+            fprintf(stderr, "%s: trace at %ld fails its checksum\n", path, pos);
+            continue;
+        }
+
+        rec_count = h.count;
+        recs = malloc(rec_count * sizeof(adc_trace_rec_t));
+        memcpy(recs, &buf[pos + sizeof(h)], rec_count * sizeof(adc_trace_rec_t));
+        free(buf);
+        return rec_count > 0;
+    }
+
+    fprintf(stderr, "%s: no ADC trace found\n", path);
+    free(buf);
+    return false;
+}
+
+static double rec_time(uint32_t i)
+{
+    return (uint32_t)(recs[i].timestamp_us - recs[0].timestamp_us) / 1e6;
+}
+
+/* ---- metrics ---- */
+
+static int cmp_float(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// Non-causal reference height on a 1 ms grid
+static float *reference;
+static uint32_t ref_len;
+
+static void build_reference(void)
+{
+    float *win = malloc(rec_count * sizeof(float));
+    uint32_t lo = 0, hi = 0;
+
+    ref_len = (uint32_t)(rec_time(rec_count - 1) * 1000) + 1;
+    reference = malloc(ref_len * sizeof(float));
+
+    for (uint32_t k = 0; k < ref_len; k++)
+    {
+        double t = k / 1000.0;
+        int n = 0;
+
+        while (lo < rec_count && rec_time(lo) < t - REF_HALF_US / 1e6)
+            lo++;
+        while (hi < rec_count && rec_time(hi) <= t + REF_HALF_US / 1e6)
+            hi++;
+        for (uint32_t i = lo; i < hi; i++)
+        {
+            float d = ir_curve_distance(recs[i].raw);
+            if (d >= 0)
+                win[n++] = d;
+        }
+
+        if (n == 0)
+            reference[k] = k ? reference[k - 1] : 0;
+        else
+        {
+            qsort(win, n, sizeof(float), cmp_float);
+            reference[k] = win[n / 2];
+        }
+    }
+    free(win);
+}
+
+// Delay that best lines the output up with the reference while moving
+static double measure_lag(const chain_t *c)
+{
+    double best_err = INFINITY;
+    int best = -1;
+
+    for (int lag = 0; lag <= MAX_LAG_MS; lag++)
+    {
+        double err = 0;
+        int n = 0;
+
+        for (uint32_t i = 0; i < c->out_count; i++)
+        {
+            long k = lround(c->out[i].t * 1000) - lag;
+            if (!c->out[i].moving || k < 0 || k >= (long)ref_len)
+                continue;
+            double e = c->out[i].height - reference[k];
+            err += e * e;
+            n++;
+        }
+        if (n > 0 && err / n < best_err)
+        {
+            best_err = err / n;
+            best = lag;
+        }
+    }
+    return best < 0 ? NAN : best;
+}
+
+// Spread of the output around its own mean over each parked stretch
+static double measure_noise(const chain_t *c)
+{
+    double sq = 0;
+    int n = 0;
+    uint32_t i = 0;
+
+    while (i < c->out_count)
+    {
+        if (c->out[i].moving)
+        {
+            i++;
+            continue;
+        }
+
+        uint32_t end = i;
+        double mean = 0;
+        while (end < c->out_count && !c->out[end].moving)
+            mean += c->out[end++].height;
+        mean /= end - i;
+        for (; i < end; i++)
+        {
+            sq += (c->out[i].height - mean) * (c->out[i].height - mean);
+            n++;
+        }
+    }
+    return n > 1 ? sqrt(sq / (n - 1)) : NAN;
+}
+
+// Largest swing past the settled height, in the direction of travel, after a stop
+static double measure_overshoot(const chain_t *c)
+{
+    double worst = NAN;
+
+    for (uint32_t i = 1; i < c->out_count; i++)
+    {
+        if (!c->out[i - 1].moving || c->out[i].moving)
+            continue;
+
+        double stop = c->out[i].t, settled = 0;
+        int n = 0;
+        for (uint32_t j = i; j < c->out_count && !c->out[j].moving; j++)
+        {
+            double age = (c->out[j].t - stop) * 1e6;
+            if (age >= SETTLE_START_US && age <= SETTLE_END_US)
+            {
+                settled += c->out[j].height;
+                n++;
+            }
+        }
+        if (n == 0)
+            continue;
+        settled /= n;
+
+        // direction of travel from the output itself
+        int up = c->out[i].height >= c->out[i > 4 ? i - 4 : 0].height;
+        double peak = 0;
+        for (uint32_t j = i; j < c->out_count && (c->out[j].t - stop) * 1e6 < SETTLE_START_US; j++)
+        {
+            double past = up ? c->out[j].height - settled : settled - c->out[j].height;
+            if (past > peak)
+                peak = past;
+        }
+        if (isnan(worst) || peak > worst)
+            worst = peak;
+    }
+    return worst;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run_chain(chain_t *c)
+{
+    float height;
+
+    c->out = malloc(rec_count * sizeof(sample_out_t));
+    c->out_count = 0;
+    c->reset(c);
+    for (uint32_t i = 0; i < rec_count; i++)
+    {
+        if (c->feed(c, &recs[i], &height))
+            c->out[c->out_count++] = (sample_out_t){rec_time(i), height,
+                                                    recs[i].motor & ADC_TRACE_RUNNING};
+    }
+
+    // Timing pass without the bookkeeping
+    double start = now_ns();
+    volatile float sink = 0;
+    for (int k = 0; k < REPEATS; k++)
+    {
+        c->reset(c);
+        for (uint32_t i = 0; i < rec_count; i++)
+            if (c->feed(c, &recs[i], &height))
+                sink += height;
+    }
+    c->ns_per_sample = (now_ns() - start) / REPEATS / rec_count;
+}
+
+static void write_csv(const char *path, chain_t *chains, int n)
+{
+    FILE *f = fopen(path, "w");
+    uint32_t pos[MAX_CHAINS] = {0};
+
+    if (f == NULL)
+    {
+        perror(path);
+        return;
+    }
+
+    fprintf(f, "t_s,raw,running");
+    for (int c = 0; c < n; c++)
+        fprintf(f, ",%s", chains[c].name);
+    fprintf(f, "\n");
+
+    for (uint32_t i = 0; i < rec_count; i++)
+    {
+        double t = rec_time(i);
+
+        fprintf(f, "%.6f,%u,%d", t, recs[i].raw, !!(recs[i].motor & ADC_TRACE_RUNNING));
+        for (int c = 0; c < n; c++)
+        {
+            while (pos[c] < chains[c].out_count && chains[c].out[pos[c]].t <= t)
+                pos[c]++;
+            if (pos[c])
+                fprintf(f, ",%.2f", chains[c].out[pos[c] - 1].height);
+            else
+                fprintf(f, ",");
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+}
+
+static chain_t *add_firmware(chain_t *chains, int *n, int idle, int moving, float alpha, float beta)
+{
+    chain_t *c = &chains[(*n)++];
+
+    memset(c, 0, sizeof(*c));
+    c->reset = firmware_reset;
+    c->feed = firmware_feed;
+    c->window[0] = idle;
+    c->window[1] = moving;
+    c->alpha = alpha;
+    c->beta = beta;
+    return c;
+}
+
+int main(int argc, char **argv)
+{
+    static chain_t chains[MAX_CHAINS];
+    const char *csv = NULL;
+    int n = 0, opt;
+
+    ir_curve_init();
+
+    strcpy(add_firmware(chains, &n, IDLE_WINDOW, MOVING_WINDOW,
+                        DIST_EST_ALPHA, DIST_EST_BETA)->name, "firmware");
+
+    chain_t *legacy = &chains[n++];
+    strcpy(legacy->name, "legacy");
+    legacy->reset = legacy_reset;
+    legacy->feed = legacy_feed;
+
+    while ((opt = getopt(argc, argv, "c:o:")) != -1)
+    {
+        int idle, moving;
+        float alpha, beta;
+
+        if (opt == 'o')
+            csv = optarg;
+        else if (opt == 'c' && n < MAX_CHAINS &&
+                 sscanf(optarg, "%d,%d,%f,%f", &idle, &moving, &alpha, &beta) == 4 &&
+                 idle > 0 && idle <= MEDIAN_WINDOW_MAX && moving > 0 && moving <= MEDIAN_WINDOW_MAX)
+        {
+            chain_t *c = add_firmware(chains, &n, idle, moving, alpha, beta);
+            snprintf(c->name, sizeof(c->name), "w%d/%d_a%.3g_b%.3g", idle, moving, alpha, beta);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-c idle,moving,alpha,beta]... [-o out.csv] trace.bin\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind >= argc || !load_trace(argv[optind]))
+        return 1;
+
+    printf("%u samples over %.2f s\n\n", rec_count, rec_time(rec_count - 1));
+    build_reference();
+
+    printf("%-24s %8s %8s %10s %10s %8s\n", "chain", "outputs", "lag_ms", "noise_mm", "oversh_mm", "ns/smp");
+    for (int c = 0; c < n; c++)
+    {
+        run_chain(&chains[c]);
+        printf("%-24s %8u %8.0f %10.3f %10.3f %8.1f\n", chains[c].name, chains[c].out_count,
+               measure_lag(&chains[c]), measure_noise(&chains[c]),
+               measure_overshoot(&chains[c]), chains[c].ns_per_sample);
+    }
+
+    if (csv)
+        write_csv(csv, chains, n);
+    return 0;
+}